@@ -0,0 +1,100 @@
+/**
+ * Benchmark of validating many small messages scattered through memory,
+ * comparing the stream parser in a loop against interleaved validation with
+ * bencode_stream_validate_batch. Both make the same check.
+ * bencode_validate is timed for reference only; it is a looser check (it
+ * allows trailing data and doesn't look at dict keys), so it isn't a like
+ * for like comparison.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bencode.h"
+#include "bencode_stream.h"
+
+/* 512MB, so that messages don't stay in the last level cache */
+#define NMSG (128 * 1024)
+#define SLOT 4096
+
+static double __now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int __make_msg(char *buf, int i)
+{
+    int len, j;
+
+    len = sprintf(buf, "d1:rd2:id20:abcdefghij0123456789"
+                  "5:nodesl");
+    for (j = 0; j < 8; j++)
+        len += sprintf(buf + len, "i%de6:%06d", i + j, j);
+    len += sprintf(buf + len, "ee1:t2:aa1:y1:re");
+    return len;
+}
+
+int main(void)
+{
+    char *arena = malloc((size_t)NMSG * SLOT);
+    const char **bufs = malloc(sizeof(char *) * NMSG);
+    int *lens = malloc(sizeof(int) * NMSG);
+    int *results = malloc(sizeof(int) * NMSG);
+    int i, used, nvalid;
+    double start;
+
+    /* visit messages in random order so every one is a cache miss */
+    for (i = 0; i < NMSG; i++)
+    {
+        long int slot = i;
+
+        bufs[i] = arena + slot * SLOT;
+        lens[i] = __make_msg((char *)bufs[i], i);
+    }
+    srand(1);
+    for (i = NMSG - 1; 0 < i; i--)
+    {
+        int j = rand() % (i + 1), l = lens[i];
+        const char *b = bufs[i];
+
+        bufs[i] = bufs[j];
+        lens[i] = lens[j];
+        bufs[j] = b;
+        lens[j] = l;
+    }
+
+    start = __now();
+    for (nvalid = 0, i = 0; i < NMSG; i++)
+        nvalid += 0 == bencode_validate((char *)bufs[i], lens[i]);
+    printf("bencode_validate loop:  %6.1f ns/msg (%d valid; looser check)\n",
+           (__now() - start) / NMSG, nvalid);
+
+    start = __now();
+    for (nvalid = 0, i = 0; i < NMSG; i++)
+    {
+        bencode_stream_t s;
+
+        bencode_stream_init(&s);
+        nvalid += BENCODE_STREAM_DONE ==
+            bencode_stream_feed(&s, bufs[i], lens[i], &used) &&
+            used == lens[i];
+    }
+    printf("stream loop:            %6.1f ns/msg (%d valid)\n",
+           (__now() - start) / NMSG, nvalid);
+
+    start = __now();
+    nvalid = bencode_stream_validate_batch(bufs, lens, NMSG, results);
+    printf("interleaved batch (%d): %6.1f ns/msg (%d valid)\n",
+           BENCODE_STREAM_BATCH_WIDTH, (__now() - start) / NMSG, nvalid);
+
+    free(arena);
+    free(bufs);
+    free(lens);
+    free(results);
+    return 0;
+}
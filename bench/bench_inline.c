@@ -0,0 +1,62 @@
+/**
+ * Benchmark of iterating a long list of ints. Build it with and without
+ * BENCODE_HEADER_ONLY to see what calling the predicates across the library
+ * boundary costs per element.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bencode.h"
+
+#define NINTS (1024 * 1024)
+#define ROUNDS 10
+
+static double __now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void)
+{
+    char *buf = malloc(NINTS * 4 + 2);
+    int i, len = 0, r;
+    long int n = 0;
+    double start, best = 0;
+
+    buf[len++] = 'l';
+    for (i = 0; i < NINTS; i++)
+        len += sprintf(buf + len, "i%de", i % 10);
+    buf[len++] = 'e';
+
+    for (r = 0; r < ROUNDS; r++)
+    {
+        bencode_t list, item;
+        double t;
+
+        start = __now();
+        bencode_init(&list, buf, len);
+        while (bencode_list_has_next(&list))
+        {
+            bencode_list_get_next(&list, &item);
+            n += bencode_is_int(&item) && !bencode_is_string(&item);
+        }
+        t = __now() - start;
+        if (0 == r || t < best)
+            best = t;
+    }
+
+#ifdef BENCODE_HEADER_ONLY
+    printf("inline predicates:  ");
+#else
+    printf("library predicates: ");
+#endif
+    printf("%5.2f ns/element (%ld ints)\n", best / NINTS, n / ROUNDS);
+
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,203 @@
+/**
+ * Loopback benchmark comparing the stream parser against buffering a
+ * whole message and then calling bencode_validate.
+ *
+ * A writer thread sends each message over a socketpair in small chunks and
+ * waits for a one byte acknowledgement, so the reported latency is the
+ * round trip for a single message.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "bencode.h"
+#include "bencode_stream.h"
+
+#define NMSG 20000
+#define CHUNK 512
+#define MAX_MSG (64 * 1024)
+
+static char msg[MAX_MSG];
+static int msglen;
+
+typedef struct
+{
+    int fd;
+    int framed;
+} writer_t;
+
+static double __now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void __make_msg(void)
+{
+    int i;
+
+    msglen = sprintf(msg, "d1:rd2:id20:abcdefghij0123456789"
+                     "6:valuesl");
+    for (i = 0; i < 100; i++)
+        msglen += sprintf(msg + msglen, "6:%06d", i);
+    msglen += sprintf(msg + msglen, "ee1:t2:aa1:y1:re");
+}
+
+static int __write_all(int fd, const char *buf, int len)
+{
+    while (0 < len)
+    {
+        int n = write(fd, buf, len);
+
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void *__writer(void *arg)
+{
+    writer_t *w = arg;
+    int i, off;
+    char ack;
+
+    for (i = 0; i < NMSG; i++)
+    {
+        if (w->framed)
+        {
+            unsigned char hdr[4] = {
+                msglen >> 24, msglen >> 16, msglen >> 8, msglen
+            };
+
+            __write_all(w->fd, (char *)hdr, 4);
+        }
+
+        for (off = 0; off < msglen; off += CHUNK)
+            __write_all(w->fd, msg + off,
+                        msglen - off < CHUNK ? msglen - off : CHUNK);
+
+        if (1 != read(w->fd, &ack, 1))
+            break;
+    }
+
+    return NULL;
+}
+
+static int __read_full(int fd, char *buf, int len)
+{
+    int got = 0;
+
+    while (got < len)
+    {
+        int n = read(fd, buf + got, len - got);
+
+        if (n <= 0)
+            return -1;
+        got += n;
+    }
+    return 0;
+}
+
+/**
+ * Every connection needs a buffer big enough for the largest message */
+static double __run_buffered(int fd)
+{
+    static char buf[MAX_MSG];
+    double start = __now();
+    int i;
+
+    for (i = 0; i < NMSG; i++)
+    {
+        unsigned char hdr[4];
+        int len;
+
+        if (-1 == __read_full(fd, (char *)hdr, 4))
+            return -1;
+        len = hdr[0] << 24 | hdr[1] << 16 | hdr[2] << 8 | hdr[3];
+        if (-1 == __read_full(fd, buf, len))
+            return -1;
+        if (0 != bencode_validate(buf, len))
+            return -1;
+        if (1 != write(fd, "", 1))
+            return -1;
+    }
+
+    return (__now() - start) / NMSG;
+}
+
+/**
+ * Every connection only needs a bencode_stream_t; the receive buffer is
+ * scratch space that would be shared between connections */
+static double __run_stream(int fd)
+{
+    bencode_stream_t s;
+    char buf[CHUNK];
+    double start = __now();
+    int i;
+
+    for (i = 0; i < NMSG; i++)
+    {
+        int ret = BENCODE_STREAM_NEED_MORE;
+
+        bencode_stream_init(&s);
+        while (ret == BENCODE_STREAM_NEED_MORE)
+        {
+            int n = read(fd, buf, sizeof(buf)), used;
+
+            if (n <= 0)
+                return -1;
+            ret = bencode_stream_feed(&s, buf, n, &used);
+        }
+        if (ret != BENCODE_STREAM_DONE)
+            return -1;
+        if (1 != write(fd, "", 1))
+            return -1;
+    }
+
+    return (__now() - start) / NMSG;
+}
+
+static double __run(int framed)
+{
+    pthread_t th;
+    writer_t w;
+    int sv[2];
+    double ns;
+
+    if (-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+        return -1;
+    w.fd = sv[1];
+    w.framed = framed;
+    pthread_create(&th, NULL, __writer, &w);
+    ns = framed ? __run_buffered(sv[0]) : __run_stream(sv[0]);
+    pthread_join(th, NULL);
+    close(sv[0]);
+    close(sv[1]);
+    return ns;
+}
+
+int main()
+{
+    __make_msg();
+
+    /* The per connection column isn't measured; it is the size of what
+     * each approach has to keep for a connection between reads: a buffer
+     * for the largest message, or the parser's state. */
+    printf("message size: %d bytes, %d messages\n", msglen, NMSG);
+    printf("buffer then validate: %8.0f ns/msg, "
+           "%6d bytes of buffer per connection (static size)\n",
+           __run(1), MAX_MSG);
+    printf("stream parser:        %8.0f ns/msg, "
+           "%6d bytes of state per connection (static size)\n",
+           __run(0), (int)sizeof(bencode_stream_t));
+    return 0;
+}
@@ -16,8 +16,66 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+
+/* the library always provides out of line copies of the predicates */
+#undef BENCODE_HEADER_ONLY
 
 #include "bencode.h"
+#include "bencode_inline.h"
+#include "bencode_cursor.h"
+
+/* the most digits a long int can have */
+#define MAX_DIGITS 19
+
+/* USDT probes for bpftrace/perf; they are a single nop when not attached */
+#ifdef BENCODE_USDT
+#include <sys/sdt.h>
+#define BENCODE_PROBE2(name, a, b) DTRACE_PROBE2(bencode, name, a, b)
+#else
+#define BENCODE_PROBE2(name, a, b) do { } while (0)
+#endif
+
+#ifdef BENCODE_STATS
+static __thread bencode_stats_t *__stats;
+#define STAT_ADD(field, n) do { if (__stats) __stats->field += (n); } while (0)
+#define STAT_DEPTH(d) \
+    do { if (__stats && __stats->max_depth < (d)) __stats->max_depth = (d); } while (0)
+#else
+#define STAT_ADD(field, n) do { } while (0)
+#define STAT_DEPTH(d) do { } while (0)
+#endif
+
+/**
+ * Charge work to the object's budget
+ * @return 0 if we are still within budget; otherwise -1 */
+static int __charge(
+    bencode_t * be,
+    long int bytes,
+    long int values
+)
+{
+    bencode_budget_t *b = be->budget;
+
+    if (!b)
+        return 0;
+
+    b->bytes += bytes;
+    b->values += values;
+
+    if ((b->max_bytes && b->max_bytes < b->bytes) ||
+        (b->max_values && b->max_values < b->values))
+        b->exceeded = 1;
+
+    return b->exceeded ? -1 : 0;
+}
+
+static int __over_budget(
+    const bencode_t * be
+)
+{
+    return be->budget && be->budget->exceeded;
+}
 
 /**
  * Carry length over to a new bencode object.
@@ -28,7 +86,117 @@ static int __carry_length(
 )
 {
     assert(0 < be->len);
-    return be->len - (pos - be->str);
+    return be->start + be->len - pos;
+}
+
+/**
+ * Set up an item that starts at pos within this object */
+static void __init_item(
+    bencode_t * be,
+    bencode_t * item,
+    const char *pos
+)
+{
+    bencode_init(item, pos, __carry_length(be, pos));
+    item->budget = be->budget;
+    item->padded = be->padded;
+}
+
+/**
+ * Count the leading digits in 8 bytes, and work out their value
+ * @param chunk 8 bytes of input, first byte in the lowest bits
+ * @param val Value of the leading digits
+ * @return number of leading digits */
+static int __parse_digits_swar(
+    uint64_t chunk,
+    uint64_t *val
+)
+{
+    uint64_t x = chunk - 0x3030303030303030ULL;
+    uint64_t nondigit;
+    int ndigits;
+
+    /* a byte is a digit if it is within '0'..'9' */
+    nondigit = (x | (x + 0x0606060606060606ULL)) & 0xF0F0F0F0F0F0F0F0ULL;
+    ndigits = nondigit ? __builtin_ctzll(nondigit) / 8 : 8;
+    *val = 0;
+    if (0 == ndigits)
+        return 0;
+
+    /* right align the digits, padding with leading zeros */
+    x <<= 8 * (8 - ndigits);
+
+    x = (x * 10) + (x >> 8);
+    x = (((x & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+         (((x >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+
+    *val = x;
+    return ndigits;
+}
+
+static const uint64_t __pow10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL
+};
+
+/**
+ * Read a run of digits, giving up after MAX_DIGITS significant digits.
+ * Leading zeros are skipped, so they don't count towards the limit.
+ * The digits are read eight at a time while that many bytes can be read.
+ * @param end Input ends here
+ * @param pad Number of bytes past end that can be read
+ * @param ndigits Number of significant digits read; 1 for a run of zeros
+ * @return pointer to the first byte after the digits */
+static const char *__read_digits(
+    const char *sp,
+    const char *end,
+    int pad,
+    uint64_t *val,
+    int *ndigits
+)
+{
+    const char *zeros = sp;
+
+    *val = 0;
+    *ndigits = 0;
+
+    while (sp < end && '0' == *sp)
+        sp++;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (sp + 8 <= end + pad)
+    {
+        uint64_t chunk, part;
+        int k;
+
+        memcpy(&chunk, sp, sizeof(chunk));
+        k = __parse_digits_swar(chunk, &part);
+        *val = *val * __pow10[k] + part;
+        sp += k;
+        *ndigits += k;
+        if (k < 8 || MAX_DIGITS < *ndigits)
+            break;
+    }
+#else
+    (void)pad;
+#endif
+
+    while (sp < end && isdigit(*sp) && *ndigits <= MAX_DIGITS)
+    {
+        *val = *val * 10 + (*sp++ - '0');
+        (*ndigits)++;
+    }
+
+    if (0 == *ndigits && zeros < sp)
+        *ndigits = 1;
+    return sp;
+}
+
+static int __pad(
+    const bencode_t * be
+)
+{
+    return be->padded ? BENCODE_PADDING : 0;
 }
 
 /**
@@ -36,171 +204,174 @@ static int __carry_length(
  * @param val Output of number represented by string 
  * @return 0 if error; otherwise 1 */
 static long int __read_string_int(
+    const bencode_t * be,
     const char *sp,
     const char **end,
     long int *val
 )
 {
-    *val = 0;
+    const char *bend = be->start + be->len;
+    uint64_t v;
+    int ndigits, sign = 1;
 
-    int sign = 1;
+    *val = 0;
 
     /* negative */
-    if ('-' == *sp)
+    if (sp < bend && '-' == *sp)
     {
         sign = -1;
         sp++;
     }
 
-    if (!isdigit(*sp))
+    sp = __read_digits(sp, bend, __pad(be), &v, &ndigits);
+    if (0 == ndigits || MAX_DIGITS < ndigits ||
+        (uint64_t)LONG_MAX + (sign < 0) < v)
         return 0;
 
-    /* work out number */
-    do
-    {
-        *val *= 10;
-        *val += *sp - '0';
-        sp++;
-    }
-    while (isdigit(*sp));
-
-    *val *= sign;
+    /* the digits have to be terminated within the buffer */
+    if (bend <= sp || *sp != 'e')
+        return 0;
 
+    *val = sign < 0 ? (long int)(0 - v) : (long int)v;
     *end = sp;
     return 1;
 }
 
-int bencode_is_dict(
-    const bencode_t * be
+/**
+ * @param slen Length of the string
+ * @return pointer to the string; NULL if the length is invalid */
+static const char *__read_string_len(
+    const bencode_t * be,
+    const char *sp,
+    int *slen
 )
 {
-    return be->str && *be->str == 'd';
-}
+    const char *end = be->start + be->len;
+    uint64_t v;
+    int ndigits;
 
-int bencode_is_int(
-    const bencode_t * be
-)
-{
-    return be->str && *be->str == 'i';
-}
+    *slen = 0;
 
-int bencode_is_list(
-    const bencode_t * be
-)
-{
-    return be->str && *be->str == 'l';
+    sp = __read_digits(sp, end, __pad(be), &v, &ndigits);
+    if (0 == ndigits || MAX_DIGITS < ndigits || INT_MAX < v)
+        return NULL;
+
+    if (end <= sp || *sp != ':')
+        return NULL;
+
+    *slen = v;
+    return sp + 1;
 }
 
-int bencode_is_string(
-    const bencode_t * be
+/**
+ * __bencode_container_end, counting the 'e' as touched */
+static const char *__container_end(
+    const bencode_t * c
 )
 {
-    const char *sp;
-
-    sp = be->str;
-
-    assert(sp);
-
-    if (!isdigit(*sp))
-        return 0;
-
-    do sp++;
-    while (isdigit(*sp));
+    const char *sp = __bencode_container_end(c);
 
-    return *sp == ':';
+    if (sp)
+        STAT_ADD(bytes_touched, 1);
+    return sp;
 }
 
+enum {
+    C_INVALID,
+    C_OPEN,
+    C_CLOSE,
+    C_INT,
+    C_STRING
+};
+
+/* what each byte can start */
+static const unsigned char __class[256] = {
+    ['d'] = C_OPEN, ['l'] = C_OPEN, ['e'] = C_CLOSE, ['i'] = C_INT,
+    ['0'] = C_STRING, ['1'] = C_STRING, ['2'] = C_STRING, ['3'] = C_STRING,
+    ['4'] = C_STRING, ['5'] = C_STRING, ['6'] = C_STRING, ['7'] = C_STRING,
+    ['8'] = C_STRING, ['9'] = C_STRING
+};
+
 /**
- * Move to next item
+ * Find the end of a value in one pass, counting nesting instead of
+ * recursing into it. Dict keys are not checked to be strings; that is left
+ * to whoever iterates over the dict.
  * @param sp The bencode string we are processing
- * @return Pointer to string on success, otherwise NULL */
-static const char *__iterate_to_next_string_pos(
+ * @return Pointer to one past the value on success, otherwise NULL */
+static const char *__find_value_end(
     bencode_t * be,
     const char *sp
 )
 {
-    bencode_t iter;
-
-    bencode_init(&iter, sp, __carry_length(be, sp));
-
-    if (bencode_is_dict(&iter))
-    {
-        /* navigate to the end of the dictionary */
-        while (bencode_dict_has_next(&iter))
-        {
-            /* ERROR: input string is invalid */
-            if (0 == bencode_dict_get_next(&iter, NULL, NULL, NULL))
-                return NULL;
-        }
-
-        /* special case for empty dict */
-        if (*iter.str == 'd' && *(iter.str + 1) == 'e')
-            return iter.str + 2;
-
-        return iter.str + 1;
-    }
-    else if (bencode_is_list(&iter))
-    {
-        /* navigate to the end of the list */
-        while (bencode_list_has_next(&iter))
-        {
-            /* ERROR: input string is invalid */
-            if (-1 == bencode_list_get_next(&iter, NULL))
-                return NULL;
-        }
+    const char *end = be->start + be->len;
+    long int depth = 0;
 
-        return iter.str + 1;
-    }
-    else if (bencode_is_string(&iter))
+    do
     {
-        int len;
         const char *str;
-
-        /* ERROR: input string is invalid */
-        if (0 == bencode_string_value(&iter, &str, &len))
-            return NULL;
-
-        return str + len;
-    }
-    else if (bencode_is_int(&iter))
-    {
-        const char *end;
         long int val;
+        int len;
 
-        if (0 == __read_string_int(&iter.str[1], &end, &val))
+        if (end <= sp)
             return NULL;
 
-        assert(end[0] == 'e');
-
-        return end + 1;
+        switch (__class[(unsigned char)*sp])
+        {
+        case C_OPEN:
+            depth++;
+            sp++;
+            break;
+        case C_CLOSE:
+            if (0 == depth)
+                return NULL;
+            depth--;
+            sp++;
+            break;
+        case C_INT:
+            if (0 == __read_string_int(be, sp + 1, &str, &val))
+                return NULL;
+            sp = str + 1;
+            break;
+        case C_STRING:
+            if (!(str = __read_string_len(be, sp, &len)) || end - str < len)
+                return NULL;
+            if (be->budget && be->budget->max_string &&
+                be->budget->max_string < len)
+            {
+                be->budget->exceeded = 1;
+                return NULL;
+            }
+            sp = str + len;
+            break;
+        default:
+            return NULL;
+        }
     }
+    while (0 < depth);
 
-    /* input string is invalid */
-    return NULL;
+    return sp;
 }
 
-static const char *__read_string_len(
-    const char *sp,
-    int *slen
+static const char *__iterate_to_next_string_pos(
+    bencode_t * be,
+    const char *sp
 )
 {
-    *slen = 0;
+    const char *end;
 
-    if (!isdigit(*sp))
+    if (__over_budget(be))
         return NULL;
 
-    do
-    {
-        *slen *= 10;
-        *slen += *sp - '0';
-        sp++;
-    }
-    while (isdigit(*sp));
+    end = __find_value_end(be, sp);
 
-    assert(*sp == ':');
-    assert(0 <= *slen);
+    STAT_ADD(rescans, 1);
+    if (end)
+        STAT_ADD(bytes_touched, end - sp);
 
-    return sp + 1;
+    if (end && -1 == __charge(be, end - sp, 0))
+        return NULL;
+
+    return end;
 }
 
 void bencode_init(
@@ -216,42 +387,26 @@ void bencode_init(
     /* assert(0 < be->len); */
 }
 
-int bencode_int_value(
+void bencode_init_padded(
     bencode_t * be,
-    long int *val
+    const char *str,
+    const int len
 )
 {
-    const char *end;
-
-    if (0 == __read_string_int(&be->str[1], &end, val))
-        return 0;
-
-    assert(end[0] == 'e');
-
-    return 1;
+    bencode_init(be, str, len);
+    be->padded = 1;
 }
 
-int bencode_dict_has_next(
-    bencode_t * be
+int bencode_int_value(
+    bencode_t * be,
+    long int *val
 )
 {
-    const char *sp = be->str;
-
-    assert(be);
+    const char *end;
 
-    if (!sp
-        /* at end of dict */
-        || *sp == 'e'
-        /* at end of string */
-        || *sp == '\0'
-        || *sp == '\r'
-        /* empty dict */
-        || (*sp == 'd' && *(sp + 1) == 'e')
-        /* at the end of the input string */
-        || be->str >= be->start + be->len - 1)
-    {
+    if (!bencode_is_int(be) ||
+        0 == __read_string_int(be, &be->str[1], &end, val))
         return 0;
-    }
 
     return 1;
 }
@@ -267,6 +422,9 @@ int bencode_dict_get_next(
     const char *keyin;
     int len;
 
+    if (!__bencode_readable(be, sp))
+        return 0;
+
     assert(*sp != 'e');
 
     /* if at start increment to 1st key */
@@ -276,19 +434,27 @@ int bencode_dict_get_next(
     }
 
     /* can't get the next item if we are at the end of the dict */
-    if (*sp == 'e')
+    if (!__bencode_readable(be, sp) || *sp == 'e')
     {
         return 0;
     }
 
     /* 1. find out what the key's length is */
-    keyin = __read_string_len(sp, &len);
+    keyin = __read_string_len(be, sp, &len);
+
+    /* the key and its value have to be within the buffer */
+    if (!keyin || !__bencode_readable(be, keyin + len))
+        return 0;
+
+    STAT_ADD(bytes_touched, keyin + len - be->str);
 
     /* 2. if we have a value bencode, lets put the value inside */
     if (be_item)
     {
         *klen = len;
-        bencode_init(be_item, keyin + len, __carry_length(be, keyin + len));
+        __init_item(be, be_item, keyin + len);
+        if (-1 == __charge(be, 0, 1))
+            return 0;
     }
 
     /* 3. iterate to next dict key, or move to next item in parent */
@@ -327,47 +493,27 @@ int bencode_string_value(
 
     *slen = 0;
     
-    assert(bencode_is_string(be));
+    /* a string cut short by the buffer isn't a string */
+    sp = __read_string_len(be, be->str, slen);
     
-    sp = __read_string_len(be->str, slen);
-    
-    assert(sp);
     assert(0 < be->len);
     
     /*  make sure we still fit within the buffer */
-    if (sp + *slen > be->start + (long int) be->len)
+    if (!sp || sp + *slen > be->start + (long int) be->len)
     {
         *str = NULL;
         return 0;
     }
 
-    *str = sp;
-    return 1;
-}
-
-int bencode_list_has_next(
-    bencode_t * be
-)
-{
-    const char *sp;
-
-    sp = be->str;
-    
-    /* empty list */
-    if (*sp == 'l' &&
-        sp == be->start &&
-        *(sp + 1) == 'e')
-    {
-        be->str++;
-        return 0;
-    }
-
-    /* end of list */
-    if (*sp == 'e')
+    if (be->budget && be->budget->max_string &&
+        be->budget->max_string < *slen)
     {
+        be->budget->exceeded = 1;
+        *str = NULL;
         return 0;
     }
 
+    *str = sp;
     return 1;
 }
 
@@ -385,7 +531,7 @@ int bencode_list_get_next(
 #endif
 
     /* we're at the end */
-    if (!sp || *sp == 'e')
+    if (!__bencode_readable(be, sp) || *sp == 'e')
         return 0;
 
     if (*sp == 'l')
@@ -397,6 +543,12 @@ int bencode_list_get_next(
         }
     }
 
+    /* the list isn't terminated within the buffer */
+    if (!__bencode_readable(be, sp))
+        return -1;
+
+    STAT_ADD(bytes_touched, sp - be->str);
+
     /* can't get the next item if we are at the end of the list */
     if (*sp == 'e')
     {
@@ -407,7 +559,9 @@ int bencode_list_get_next(
     /* populate the be_item if it is available */
     if (be_item)
     {
-        bencode_init(be_item, sp, __carry_length(be, sp));
+        __init_item(be, be_item, sp);
+        if (-1 == __charge(be, 0, 1))
+            return -1;
     }
 
     /* iterate to next value */
@@ -419,6 +573,98 @@ int bencode_list_get_next(
     return 1;
 }
 
+int bencode_list_get_batch(
+    bencode_t * be,
+    bencode_t * items,
+    int cap
+)
+{
+    const char *sp = be->str;
+    int n;
+
+    if (!__bencode_readable(be, sp) || *sp == 'e')
+        return 0;
+
+    /* move off the start of this list once per batch, not once per item */
+    if (*sp == 'l' && be->start == be->str)
+        sp++;
+
+    for (n = 0; n < cap; n++)
+    {
+        /* the list isn't terminated within the buffer */
+        if (!__bencode_readable(be, sp))
+            return -1;
+
+        if (*sp == 'e')
+            break;
+
+        __builtin_prefetch(sp + BENCODE_BATCH_PREFETCH);
+        __init_item(be, &items[n], sp);
+        if (-1 == __charge(be, 0, 1))
+            return -1;
+
+        if (!(sp = __iterate_to_next_string_pos(be, sp)))
+        {
+            be->str = NULL;
+            return -1;
+        }
+    }
+
+    be->str = sp;
+    return n;
+}
+
+int bencode_dict_get_batch(
+    bencode_t * be,
+    const char **keys,
+    int *klens,
+    bencode_t * items,
+    int cap
+)
+{
+    const char *sp = be->str;
+    const char *keyin;
+    int n, len;
+
+    if (!__bencode_readable(be, sp) || *sp == 'e')
+        return 0;
+
+    /* move off the start of this dict once per batch */
+    if (*sp == 'd')
+        sp++;
+
+    for (n = 0; n < cap; n++)
+    {
+        if (!__bencode_readable(be, sp))
+            return -1;
+
+        if (*sp == 'e')
+            break;
+
+        __builtin_prefetch(sp + BENCODE_BATCH_PREFETCH);
+
+        /* the key and its value have to be within the buffer */
+        keyin = __read_string_len(be, sp, &len);
+        if (!keyin || !__bencode_readable(be, keyin + len))
+            return -1;
+
+        keys[n] = keyin;
+        klens[n] = len;
+        __init_item(be, &items[n], keyin + len);
+        if (-1 == __charge(be, 0, 1))
+            return -1;
+
+        if (!(sp = __iterate_to_next_string_pos(be, keyin + len)))
+        {
+            be->str = NULL;
+            return -1;
+        }
+    }
+
+    be->str = sp;
+    return n;
+}
+
 void bencode_clone(
     bencode_t * be,
     bencode_t * output
@@ -442,69 +688,884 @@ int bencode_dict_get_start_and_len(
     while (bencode_dict_has_next(&ben))
         bencode_dict_get_next(&ben, &ben2, &ren, &tmplen);
 
+    /* an empty dict leaves us on the 'd' */
+    if (ben.str == ben.start && *ben.str == 'd')
+        ben.str++;
+
     *len = ben.str - *start + 1;
     return 0;
 }
 
-static int __validate(bencode_t *ben)
+const char *bencode_value_end(
+    bencode_t * be
+)
 {
-    if (bencode_is_dict(ben))
-    {
-        while (bencode_dict_has_next(ben))
-        {
-            int klen;
-            const char *key;
-            bencode_t benk;
-
+    if (!__bencode_readable(be, be->str))
+        return NULL;
+    return __iterate_to_next_string_pos(be, be->str);
+}
+
+typedef struct
+{
+    /* start of the buffer being validated, so probes can report offsets */
+    const char *base;
+
+    /* called for strings that aren't UTF-8; can be NULL */
+    bencode_binary_f binary;
+    void *udata;
+} validate_t;
+
+/**
+ * @param depth Number of containers we are inside */
+static int __validate(bencode_t *ben, const validate_t *v, int depth)
+{
+    if (ben->budget && ben->budget->max_depth &&
+        ben->budget->max_depth <= depth &&
+        (bencode_is_dict(ben) || bencode_is_list(ben)))
+    {
+        ben->budget->exceeded = 1;
+        BENCODE_PROBE2(error, ben->str - v->base, "too deep");
+        return -1;
+    }
+
+    if (bencode_is_dict(ben))
+    {
+        BENCODE_PROBE2(container_enter, depth + 1, ben->str - v->base);
+        STAT_ADD(dicts, 1);
+        STAT_DEPTH(depth + 1);
+
+        while (bencode_dict_has_next(ben))
+        {
+            int klen;
+            const char *key;
+            bencode_t benk;
+
             if (0 == bencode_dict_get_next(ben, &benk, &key, &klen))
+            {
+                BENCODE_PROBE2(error, ben->str ? ben->str - v->base : -1,
+                               "invalid dict item");
                 return -1;
+            }
 
-            int ret = __validate(&benk);
+            int ret = __validate(&benk, v, depth + 1);
             if (0 != ret)
                 return ret;
         }
+
+        if (!__container_end(ben))
+        {
+            BENCODE_PROBE2(error, ben->str - v->base, "unterminated dict");
+            return -1;
+        }
+
+        BENCODE_PROBE2(container_exit, depth + 1, ben->str - v->base);
     }
     else if (bencode_is_list(ben))
     {
+        BENCODE_PROBE2(container_enter, depth + 1, ben->str - v->base);
+        STAT_ADD(lists, 1);
+        STAT_DEPTH(depth + 1);
+
         while (bencode_list_has_next(ben))
         {
             bencode_t benl;
 
             if (-1 == bencode_list_get_next(ben, &benl))
+            {
+                /* benl isn't set up if the list wasn't terminated */
+                BENCODE_PROBE2(error, ben->str ? ben->str - v->base : -1,
+                               "invalid list item");
                 return -1;
+            }
 
-            int ret = __validate(&benl);
+            int ret = __validate(&benl, v, depth + 1);
             if (0 != ret)
                 return ret;
         }
 
+        if (!__container_end(ben))
+        {
+            BENCODE_PROBE2(error, ben->str - v->base, "unterminated list");
+            return -1;
+        }
+
+        BENCODE_PROBE2(container_exit, depth + 1, ben->str - v->base);
     }
     else if (bencode_is_string(ben))
     {
         const char *str;
         int len;
 
+        STAT_ADD(strings, 1);
         if (0 == bencode_string_value(ben, &str, &len))
+        {
+            BENCODE_PROBE2(error, ben->str - v->base, "string too long");
             return -1;
+        }
+
+        /* check while the string is still in cache */
+        if (v->binary && !bencode_string_is_utf8(str, len))
+            v->binary(v->udata, str, len);
     }
     else if (bencode_is_int(ben))
     {
         long int val;
 
+        STAT_ADD(ints, 1);
         if (0 == bencode_int_value(ben, &val))
+        {
+            BENCODE_PROBE2(error, ben->str - v->base, "invalid int");
             return -1;
+        }
     }
     else
+    {
+        BENCODE_PROBE2(error, ben->str - v->base, "unknown type");
         return -1;
+    }
 
     return 0;
 }
 
-int bencode_validate(char* buf, int len)
+static int __validate_buf(
+    char *buf,
+    int len,
+    bencode_budget_t * budget,
+    bencode_binary_f binary,
+    void *udata
+)
 {
+    validate_t v = { buf, binary, udata };
     bencode_t ben;
+    int ret;
+
+    BENCODE_PROBE2(validate_begin, buf, len);
+    STAT_ADD(input_bytes, len);
     if (0 == len)
+    {
+        BENCODE_PROBE2(validate_end, buf, 0);
         return 0;
+    }
     bencode_init(&ben, buf, len);
-    return __validate(&ben);
+    bencode_set_budget(&ben, budget);
+    ret = __validate(&ben, &v, 0);
+    if (0 != ret && budget && budget->exceeded)
+        ret = BENCODE_ERR_BUDGET;
+    BENCODE_PROBE2(validate_end, buf, ret);
+    return ret;
+}
+
+int bencode_validate_budget(
+    char *buf,
+    int len,
+    bencode_budget_t * budget
+)
+{
+    return __validate_buf(buf, len, budget, NULL, NULL);
+}
+
+int bencode_validate_utf8(
+    char *buf,
+    int len,
+    bencode_binary_f binary,
+    void *udata
+)
+{
+    return __validate_buf(buf, len, NULL, binary, udata);
+}
+
+int bencode_validate(char* buf, int len)
+{
+    return bencode_validate_budget(buf, len, NULL);
+}
+
+void bencode_set_budget(
+    bencode_t * be,
+    bencode_budget_t * budget
+)
+{
+    be->budget = budget;
+}
+
+int bencode_stats_begin(
+    bencode_stats_t * stats
+)
+{
+#ifdef BENCODE_STATS
+    memset(stats, 0, sizeof(bencode_stats_t));
+    __stats = stats;
+    return 0;
+#else
+    (void)stats;
+    return -1;
+#endif
+}
+
+void bencode_stats_end(
+    void
+)
+{
+#ifdef BENCODE_STATS
+    __stats = NULL;
+#endif
+}
+
+double bencode_stats_work_ratio(
+    const bencode_stats_t * stats
+)
+{
+    if (0 == stats->input_bytes)
+        return 0;
+    return (double)stats->bytes_touched / stats->input_bytes;
+}
+
+/**
+ * The start of bencode_field_t and bencode_schema_t, which are both
+ * looked up by key */
+typedef struct
+{
+    const char *key;
+    int klen;
+} keyed_t;
+
+/**
+ * Find the entry for this key in an array sorted by key.
+ * Canonical dicts are sorted, so the entry after the last match is the
+ * most likely candidate; otherwise fall back to a binary search.
+ * @param arr Array of structs that start like keyed_t
+ * @param stride Size of each struct
+ * @param hint Index of the entry we expect to match next
+ * @return entry index; otherwise -1 */
+static int __find_key(
+    const void *arr,
+    size_t stride,
+    int n,
+    int hint,
+    const char *key,
+    int klen
+)
+{
+#define KEYED(i) ((const keyed_t *)((const char *)arr + (i) * stride))
+    int lo = 0, hi = n - 1;
+
+    if (hint < n &&
+        0 == __bencode_keycmp(KEYED(hint)->key, KEYED(hint)->klen, key, klen))
+        return hint;
+
+    while (lo <= hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        int ret =
+            __bencode_keycmp(KEYED(mid)->key, KEYED(mid)->klen, key, klen);
+
+        if (0 == ret)
+            return mid;
+        else if (ret < 0)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return -1;
+#undef KEYED
+}
+
+static int __bind_field(
+    const bencode_field_t * f,
+    bencode_t * item,
+    char *out
+)
+{
+    switch (f->type)
+    {
+    case BENCODE_BIND_INT:
+        if (!bencode_is_int(item))
+            return -1;
+        if (0 == bencode_int_value(item, (long int *)(out + f->offset)))
+            return -1;
+        break;
+    case BENCODE_BIND_STRING:
+        {
+            bencode_span_t *span = (bencode_span_t *)(out + f->offset);
+
+            if (!bencode_is_string(item))
+                return -1;
+            if (0 == bencode_string_value(item, &span->str, &span->len))
+                return -1;
+        }
+        break;
+    case BENCODE_BIND_VALUE:
+        bencode_clone(item, (bencode_t *)(out + f->offset));
+        break;
+    case BENCODE_BIND_DICT:
+        if (!bencode_is_dict(item))
+            return -1;
+        if (-1 == bencode_bind(item, f->sub, f->nsub, out + f->offset))
+            return -1;
+        break;
+    default:
+        return -1;
+    }
+
+    return 0;
+}
+
+int bencode_bind(
+    bencode_t * be,
+    const bencode_field_t * fields,
+    int nfields,
+    void *out
+)
+{
+    int hint = 0, bound = 0;
+
+    if (!bencode_is_dict(be))
+        return -1;
+
+    while (bencode_dict_has_next(be))
+    {
+        bencode_t item;
+        const char *key;
+        int klen, idx;
+
+        if (0 == bencode_dict_get_next(be, &item, &key, &klen))
+            return -1;
+
+        idx = __find_key(fields, sizeof(bencode_field_t), nfields, hint,
+                         key, klen);
+
+        /* unknown key */
+        if (-1 == idx)
+            continue;
+
+        if (-1 == __bind_field(&fields[idx], &item, out))
+            return -1;
+
+        hint = idx + 1;
+        bound++;
+    }
+
+    if (!__container_end(be))
+        return -1;
+
+    return bound;
+}
+
+static int __within(
+    const bencode_schema_t * s,
+    long int n
+)
+{
+    return (!(s->flags & BENCODE_SCHEMA_MIN) || s->min <= n) &&
+           (!(s->flags & BENCODE_SCHEMA_MAX) || n <= s->max);
+}
+
+/**
+ * @param err Set to where the value stopped matching
+ * @return 0 if the value matches; otherwise -1 */
+static int __schema_check(
+    bencode_t * be,
+    const bencode_schema_t * s,
+    const validate_t * v,
+    const char **err
+)
+{
+    const char *str;
+    long int val, n = 0;
+    uint64_t seen = 0, required = 0;
+    int len, hint = 0, i;
+
+    *err = be->str;
+
+    switch (s->type)
+    {
+    case BENCODE_SCHEMA_ANY:
+        return __validate(be, v, 0);
+
+    case BENCODE_SCHEMA_INT:
+        if (!bencode_int_value(be, &val) || !__within(s, val))
+            return -1;
+        return 0;
+
+    case BENCODE_SCHEMA_STRING:
+        if (!bencode_is_string(be) || !bencode_string_value(be, &str, &len) ||
+            !__within(s, len) || (s->multiple && len % s->multiple))
+            return -1;
+        return 0;
+
+    case BENCODE_SCHEMA_LIST:
+        if (!bencode_is_list(be))
+            return -1;
+
+        while (bencode_list_has_next(be))
+        {
+            bencode_t item;
+            bencode_schema_t any = { NULL, 0, BENCODE_SCHEMA_ANY, 0, 0, 0, 0,
+                                     NULL, 0 };
+
+            if (1 != bencode_list_get_next(be, &item))
+                return -1;
+            if (-1 == __schema_check(&item, s->nsub ? s->sub : &any, v, err))
+                return -1;
+            n++;
+        }
+
+        *err = be->str;
+        if (!__container_end(be) || !__within(s, n))
+            return -1;
+        return 0;
+
+    case BENCODE_SCHEMA_DICT:
+        if (!bencode_is_dict(be) || 64 < s->nsub)
+            return -1;
+
+        for (i = 0; i < s->nsub; i++)
+            if (s->sub[i].flags & BENCODE_SCHEMA_REQUIRED)
+                required |= 1ULL << i;
+
+        while (bencode_dict_has_next(be))
+        {
+            bencode_t item;
+            const char *key;
+            int klen, idx, ret;
+
+            if (0 == bencode_dict_get_next(be, &item, &key, &klen))
+                return -1;
+
+            idx = __find_key(s->sub, sizeof(bencode_schema_t), s->nsub, hint,
+                             key, klen);
+            if (-1 == idx)
+                ret = __validate(&item, v, 0);
+            else
+            {
+                ret = __schema_check(&item, &s->sub[idx], v, err);
+                seen |= 1ULL << idx;
+                hint = idx + 1;
+            }
+
+            if (0 != ret)
+                return -1;
+        }
+
+        *err = be->str;
+        if (!__container_end(be) || required != (seen & required))
+            return -1;
+        return 0;
+    }
+
+    return -1;
+}
+
+int bencode_schema_validate(
+    char *buf,
+    int len,
+    const bencode_schema_t * schema,
+    const char **err
+)
+{
+    validate_t v = { buf, NULL, NULL };
+    const char *at;
+    bencode_t ben;
+
+    bencode_init(&ben, buf, len);
+    if (0 == __schema_check(&ben, schema, &v, &at))
+        return 0;
+
+    if (err)
+        *err = at;
+    return -1;
+}
+
+/**
+ * Store the value of a matching key
+ * @param end Where the value ends
+ * @return 0 on success; otherwise -1 */
+static int __extract_value(
+    bencode_t * item,
+    const char *end,
+    void *out,
+    int as_int
+)
+{
+    bencode_span_t *span = out;
+
+    if (as_int)
+    {
+        if (!bencode_is_int(item))
+            return -1;
+        return bencode_int_value(item, out) ? 0 : -1;
+    }
+
+    if (bencode_is_string(item))
+        return bencode_string_value(item, &span->str, &span->len) ? 0 : -1;
+
+    span->str = item->str;
+    span->len = end - item->str;
+    return 0;
+}
+
+static int __list_extract(
+    bencode_t * be,
+    const char *key,
+    int klen,
+    void *out,
+    int cap,
+    int *n,
+    int as_int
+)
+{
+    const char *sp = be->str;
+
+    *n = 0;
+
+    if (!__bencode_readable(be, sp))
+        return -1;
+
+    /* at its start this has to be a list; otherwise we are resuming one */
+    if (be->start == be->str)
+    {
+        if (*sp != 'l')
+            return -1;
+        sp++;
+    }
+
+    while (__bencode_readable(be, sp) && *sp != 'e')
+    {
+        bencode_t dict;
+        void *slot;
+
+        if (cap == *n)
+        {
+            be->str = sp;
+            return 0;
+        }
+
+        __init_item(be, &dict, sp);
+        if (!bencode_is_dict(&dict))
+            return -1;
+
+        if (as_int)
+            slot = (long int *)out + *n;
+        else
+            slot = (bencode_span_t *)out + *n;
+        memset(slot, 0, as_int ? sizeof(long int) : sizeof(bencode_span_t));
+
+        /* walk the dict once; it leaves us at its end */
+        while (bencode_dict_has_next(&dict))
+        {
+            bencode_t item;
+            const char *k;
+            int kl;
+
+            if (0 == bencode_dict_get_next(&dict, &item, &k, &kl))
+                return -1;
+
+            if (kl == klen && 0 == memcmp(k, key, klen))
+                if (-1 == __extract_value(&item, dict.str, slot, as_int))
+                    return -1;
+        }
+
+        if (!(sp = __container_end(&dict)))
+            return -1;
+
+        (*n)++;
+    }
+
+    /* the list isn't terminated within the buffer */
+    if (!__bencode_readable(be, sp))
+        return -1;
+
+    be->str = sp;
+    return 1;
+}
+
+int bencode_list_extract_int(
+    bencode_t * be,
+    const char *key,
+    int klen,
+    long int *out,
+    int cap,
+    int *n
+)
+{
+    return __list_extract(be, key, klen, out, cap, n, 1);
+}
+
+int bencode_list_extract_span(
+    bencode_t * be,
+    const char *key,
+    int klen,
+    bencode_span_t * out,
+    int cap,
+    int *n
+)
+{
+    return __list_extract(be, key, klen, out, cap, n, 0);
+}
+
+int bencode_list_to_int64_array(
+    bencode_t * be,
+    int64_t *out,
+    int cap,
+    int *n
+)
+{
+    const char *sp = be->str;
+    const char *end = be->start + be->len;
+
+    *n = 0;
+
+    /* at its start this has to be a list; otherwise we are resuming one */
+    if (be->start == be->str)
+    {
+        if (end <= sp || *sp != 'l')
+            return -1;
+        sp++;
+    }
+
+    while (sp < end && *sp == 'i')
+    {
+        uint64_t val;
+        int sign = 1, ndigits;
+
+        if (cap == *n)
+        {
+            be->str = sp;
+            return 0;
+        }
+
+        sp++;
+        if (sp < end && *sp == '-')
+        {
+            sign = -1;
+            sp++;
+        }
+
+        sp = __read_digits(sp, end, __pad(be), &val, &ndigits);
+        if (0 == ndigits || MAX_DIGITS < ndigits ||
+            (uint64_t)INT64_MAX + (sign < 0) < val || end <= sp || *sp != 'e')
+            return -1;
+        sp++;
+
+        out[(*n)++] = sign < 0 ? (int64_t)(0 - val) : (int64_t)val;
+    }
+
+    /* end of list */
+    if (sp == end || *sp != 'e')
+        return -1;
+
+    be->str = sp;
+    return 1;
+}
+
+static uint32_t __keyset_hash(
+    uint32_t seed,
+    const char *key,
+    int klen
+)
+{
+    uint32_t h = seed;
+    int i;
+
+    for (i = 0; i < klen; i++)
+    {
+        h ^= (unsigned char)key[i];
+        h *= 0x01000193;
+    }
+
+    return h ^ (h >> 15);
+}
+
+/**
+ * Try to place every key with this seed
+ * @return 0 if there were no collisions; otherwise -1 */
+static int __keyset_place(
+    bencode_keyset_t * ks
+)
+{
+    int i;
+
+    memset(ks->slots, 0xff, sizeof(ks->slots));
+
+    for (i = 0; i < ks->nkeys; i++)
+    {
+        uint32_t slot = __keyset_hash(ks->seed, ks->keys[i],
+                                      ks->lens[i]) & ks->mask;
+
+        if (-1 != ks->slots[slot])
+            return -1;
+        ks->slots[slot] = i;
+    }
+
+    return 0;
+}
+
+int bencode_keyset_init(
+    bencode_keyset_t * ks,
+    const char *const *keys,
+    int nkeys
+)
+{
+    uint32_t nslots = 1;
+    int i, j;
+
+    if (BENCODE_KEYSET_MAX_SLOTS / 2 < nkeys)
+        return -1;
+
+    /* a duplicate key would never hash apart */
+    for (i = 0; i < nkeys; i++)
+        for (j = i + 1; j < nkeys; j++)
+            if (!strcmp(keys[i], keys[j]))
+                return -1;
+
+    ks->keys = keys;
+    ks->nkeys = nkeys;
+    for (i = 0; i < nkeys; i++)
+        ks->lens[i] = strlen(keys[i]);
+
+    while (nslots < (uint32_t)nkeys * 2)
+        nslots *= 2;
+
+    /* look for a seed without collisions; a sparser table makes it easier */
+    for (; nslots <= BENCODE_KEYSET_MAX_SLOTS; nslots *= 2)
+    {
+        ks->mask = nslots - 1;
+        for (ks->seed = 1; ks->seed < 10000; ks->seed++)
+            if (0 == __keyset_place(ks))
+                return 0;
+    }
+
+    return -1;
+}
+
+int bencode_keyset_lookup(
+    const bencode_keyset_t * ks,
+    const char *key,
+    int klen
+)
+{
+    int id = ks->slots[__keyset_hash(ks->seed, key, klen) & ks->mask];
+
+    if (-1 == id || ks->lens[id] != klen || 0 != memcmp(ks->keys[id], key, klen))
+        return -1;
+
+    return id;
+}
+
+int bencode_dict_get_next_id(
+    bencode_t * be,
+    bencode_t * be_item,
+    const char **key,
+    int *klen,
+    const bencode_keyset_t * ks,
+    int *id
+)
+{
+    bencode_t item;
+    const char *k;
+    int len;
+
+    *id = -1;
+    if (key)
+        *key = NULL;
+    if (klen)
+        *klen = 0;
+
+    /* get_next only fills in the key when there's an item to fill in */
+    if (0 == bencode_dict_get_next(be, be_item ? be_item : &item, &k, &len))
+        return 0;
+
+    if (key)
+        *key = k;
+    if (klen)
+        *klen = len;
+    *id = bencode_keyset_lookup(ks, k, len);
+    return 1;
+}
+
+/**
+ * @param s Start of a character that isn't ASCII
+ * @param left Bytes left in the string
+ * @return length of the character; 0 if it isn't valid UTF-8 */
+static int __utf8_char_len(
+    const unsigned char *s,
+    int left
+)
+{
+    unsigned char lo = 0x80, hi = 0xBF;
+    int n, i;
+
+    /* 0x80..0xC1 are continuations or would be overlong */
+    if (s[0] < 0xC2)
+        return 0;
+    else if (s[0] < 0xE0)
+        n = 2;
+    else if (s[0] < 0xF0)
+    {
+        n = 3;
+        /* overlong, and UTF-16 surrogates */
+        if (s[0] == 0xE0)
+            lo = 0xA0;
+        else if (s[0] == 0xED)
+            hi = 0x9F;
+    }
+    else if (s[0] < 0xF5)
+    {
+        n = 4;
+        /* overlong, and past U+10FFFF */
+        if (s[0] == 0xF0)
+            lo = 0x90;
+        else if (s[0] == 0xF4)
+            hi = 0x8F;
+    }
+    else
+        return 0;
+
+    if (left < n || s[1] < lo || hi < s[1])
+        return 0;
+
+    for (i = 2; i < n; i++)
+        if ((s[i] & 0xC0) != 0x80)
+            return 0;
+
+    return n;
+}
+
+int bencode_string_is_utf8(
+    const char *str,
+    int len
+)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    int i = 0;
+
+    while (i < len)
+    {
+        int n;
+
+        /* eight ASCII bytes at a time */
+        if (i + 8 <= len)
+        {
+            uint64_t w;
+
+            memcpy(&w, s + i, sizeof(w));
+            if (0 == (w & 0x8080808080808080ULL))
+            {
+                i += 8;
+                continue;
+            }
+        }
+
+        if (s[i] < 0x80)
+        {
+            i++;
+            continue;
+        }
+
+        if (0 == (n = __utf8_char_len(s + i, len - i)))
+            return 0;
+        i += n;
+    }
+
+    return 1;
 }
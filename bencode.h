@@ -2,6 +2,48 @@
 #ifndef BENCODE_H_
 #define BENCODE_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+/* BENCODE_HEADER_ONLY makes the type predicates and has_next calls static
+ * inline, so they are inlined into callers' loops instead of being called
+ * across the library boundary */
+#ifdef BENCODE_HEADER_ONLY
+#define BENCODE_INLINE static inline
+#else
+#define BENCODE_INLINE
+#endif
+
+/**
+ * Limits on how much work parsing untrusted input may do.
+ * A limit of 0 means no limit.
+ */
+typedef struct bencode_budget_s
+{
+    /* bytes scanned, counting every time a value is skipped over */
+    long int max_bytes;
+
+    /* values handed out by the iterators */
+    long int max_values;
+
+    int max_string;
+
+    /* only enforced by bencode_validate */
+    int max_depth;
+
+    /* usage so far */
+    long int bytes;
+    long int values;
+
+    /* set once any limit has been exceeded */
+    int exceeded;
+} bencode_budget_t;
+
+enum {
+    BENCODE_ERR_INVALID = -1,
+    BENCODE_ERR_BUDGET = -2
+};
+
 typedef struct
 {
     const char *str;
@@ -9,8 +51,22 @@ typedef struct
     void *parent;
     int val;
     int len;
+
+    /* shared with every item obtained from this object; can be NULL */
+    bencode_budget_t *budget;
+
+    /* BENCODE_PADDING bytes past the end of the buffer can be read */
+    int padded;
 } bencode_t;
 
+/* readable bytes that bencode_init_padded expects past the end of input */
+#define BENCODE_PADDING 8
+
+/* bytes ahead of the current child that batched iteration prefetches */
+#ifndef BENCODE_BATCH_PREFETCH
+#define BENCODE_BATCH_PREFETCH 256
+#endif
+
 /**
 * Initialise a bencode object.
 * @param be The bencode object
@@ -23,31 +79,46 @@ void bencode_init(
     int len
 );
 
+/**
+* Initialise a bencode object over a buffer that can be read past its end.
+* Nothing is read as input past len, but numbers can be parsed eight digits
+* at a time right up to the end of the buffer.
+* @param be The bencode object
+* @param str Buffer we expect input from
+* @param len Length of buffer; BENCODE_PADDING bytes after this must be
+*  readable, though they can hold anything
+*/
+void bencode_init_padded(
+    bencode_t * be,
+    const char *str,
+    int len
+);
+
 /**
 * @return 1 if the bencode object is an int; otherwise 0.
 */
-int bencode_is_int(
+BENCODE_INLINE int bencode_is_int(
     const bencode_t * be
 );
 
 /**
 * @return 1 if the bencode object is a string; otherwise 0.
 */
-int bencode_is_string(
+BENCODE_INLINE int bencode_is_string(
     const bencode_t * be
 );
 
 /**
 * @return 1 if the bencode object is a list; otherwise 0.
 */
-int bencode_is_list(
+BENCODE_INLINE int bencode_is_list(
     const bencode_t * be
 );
 
 /**
 * @return 1 if the bencode object is a dict; otherwise 0.
 */
-int bencode_is_dict(
+BENCODE_INLINE int bencode_is_dict(
     const bencode_t * be
 );
 
@@ -64,7 +135,7 @@ int bencode_int_value(
 /**
 * @return 1 if there is another item on this dict; otherwise 0.
 */
-int bencode_dict_has_next(
+BENCODE_INLINE int bencode_dict_has_next(
     bencode_t * be
 );
 
@@ -101,7 +172,7 @@ int bencode_string_value(
 * @param be The bencode object
 * @return 1 if another item exists on the list; 0 otherwise; -1 on invalid processing
 */
-int bencode_list_has_next(
+BENCODE_INLINE int bencode_list_has_next(
     bencode_t * be
 );
 
@@ -116,6 +187,37 @@ int bencode_list_get_next(
     bencode_t * be_item
 );
 
+/**
+* Get the next few items within this list in one go.
+* The list's setup is done once per batch rather than once per item.
+* @param be The bencode object
+* @param items Array of bencode objects that we are going to initiate
+* @param cap Length of the array
+* @return number of items obtained, 0 on end; -1 on error
+*/
+int bencode_list_get_batch(
+    bencode_t * be,
+    bencode_t * items,
+    int cap
+);
+
+/**
+* Get the next few items within this dictionary in one go.
+* @param be The bencode object
+* @param keys Array of const pointers to the key string of each item
+* @param klens Array of key lengths
+* @param items Array of items
+* @param cap Length of the arrays
+* @return number of items obtained, 0 on end; -1 on error
+*/
+int bencode_dict_get_batch(
+    bencode_t * be,
+    const char **keys,
+    int *klens,
+    bencode_t * items,
+    int cap
+);
+
 /**
  * Copy bencode object into other bencode object
  */
@@ -137,4 +239,393 @@ int bencode_dict_get_start_and_len(
     int *len
 );
 
+/**
+* Find where a value ends, skipping over everything nested within it.
+* @param be Bencode object, at the start of the value
+* @return pointer to one past the end of the value; NULL if the value is
+*  invalid or isn't terminated within the buffer
+*/
+const char *bencode_value_end(
+    bencode_t * be
+);
+
+/**
+* Check that the buffer holds a single well formed bencoded value.
+* @param buf Buffer to validate
+* @param len Length of buffer
+* @return 0 if valid; otherwise -1
+*/
+int bencode_validate(
+    char *buf,
+    int len
+);
+
+/**
+ * Called for a string value that isn't valid UTF-8
+ * @param udata User data given to the validator
+ * @param str The string
+ * @param len Length of the string
+ */
+typedef void (*bencode_binary_f)(
+    void *udata,
+    const char *str,
+    int len
+);
+
+/**
+* Check that the buffer holds a single well formed bencoded value, and
+* report string values that aren't UTF-8.
+* Each string is checked straight after it has been validated, while it is
+* still in cache. Dict keys aren't checked.
+* @param buf Buffer to validate
+* @param len Length of buffer
+* @param binary Called for each string value that isn't valid UTF-8
+* @param udata Passed to binary
+* @return 0 if valid; otherwise -1. Strings that aren't UTF-8 don't make the
+*  buffer invalid
+*/
+int bencode_validate_utf8(
+    char *buf,
+    int len,
+    bencode_binary_f binary,
+    void *udata
+);
+
+/**
+* Check that a string is valid UTF-8.
+* Overlong forms, UTF-16 surrogates and code points past U+10FFFF are
+* rejected. ASCII is checked eight bytes at a time.
+* @param str The string, eg. from bencode_string_value
+* @param len Length of the string
+* @return 1 if the string is valid UTF-8; otherwise 0
+*/
+int bencode_string_is_utf8(
+    const char *str,
+    int len
+);
+
+/**
+* Check that the buffer holds a single well formed bencoded value, without
+* going over a budget.
+* @param buf Buffer to validate
+* @param len Length of buffer
+* @param budget Limits to stay within; can be NULL
+* @return 0 if valid; BENCODE_ERR_BUDGET if a limit was exceeded;
+*  otherwise BENCODE_ERR_INVALID
+*/
+int bencode_validate_budget(
+    char *buf,
+    int len,
+    bencode_budget_t * budget
+);
+
+/**
+* Make all parsing through this object and its items charge a budget.
+* Once a limit is exceeded the iterators fail as they would on invalid
+* input, and budget->exceeded tells the two apart.
+* @param be The bencode object
+* @param budget Budget to charge; can be NULL
+*/
+void bencode_set_budget(
+    bencode_t * be,
+    bencode_budget_t * budget
+);
+
+/**
+ * A view of a string value inside the input buffer
+ */
+typedef struct
+{
+    const char *str;
+    int len;
+} bencode_span_t;
+
+enum {
+    /** member is a long int */
+    BENCODE_BIND_INT,
+    /** member is a bencode_span_t */
+    BENCODE_BIND_STRING,
+    /** member is a bencode_t, which can be of any type */
+    BENCODE_BIND_VALUE,
+    /** member is a struct that is bound with the sub fields */
+    BENCODE_BIND_DICT
+};
+
+/**
+ * Describes how a dict key maps onto a struct member
+ */
+typedef struct bencode_field_s
+{
+    const char *key;
+    int klen;
+    int type;
+    size_t offset;
+    const struct bencode_field_s *sub;
+    int nsub;
+} bencode_field_t;
+
+#define BENCODE_FIELD(st, member, key, type) \
+    { key, sizeof(key) - 1, type, offsetof(st, member), NULL, 0 }
+
+#define BENCODE_FIELD_DICT(st, member, key, sub) \
+    { key, sizeof(key) - 1, BENCODE_BIND_DICT, offsetof(st, member), \
+      sub, sizeof(sub) / sizeof((sub)[0]) }
+
+/**
+* Decode a dict straight into a struct in a single pass.
+* Fields must be sorted by key in raw byte order (ie. bencode dict order).
+* Keys that have no field are skipped. Members of missing keys are left
+* untouched, so the struct should be zeroed first.
+* @param be The dict bencode object
+* @param fields Field table describing the struct
+* @param nfields Number of fields in the table
+* @param out The struct we are writing to
+* @return number of fields bound; -1 on invalid input or type mismatch
+*/
+int bencode_bind(
+    bencode_t * be,
+    const bencode_field_t * fields,
+    int nfields,
+    void *out
+);
+
+enum {
+    /** any well formed value */
+    BENCODE_SCHEMA_ANY,
+    BENCODE_SCHEMA_INT,
+    BENCODE_SCHEMA_STRING,
+    /** every item matches sub[0]; any item if there is no sub */
+    BENCODE_SCHEMA_LIST,
+    /** keys described by sub, sorted by key; other keys can be anything */
+    BENCODE_SCHEMA_DICT
+};
+
+/** the key has to be in the dict */
+#define BENCODE_SCHEMA_REQUIRED 1
+/** min is a lower bound */
+#define BENCODE_SCHEMA_MIN 2
+/** max is an upper bound */
+#define BENCODE_SCHEMA_MAX 4
+
+/**
+ * Describes the expected shape of a value, and of a dict key's value when
+ * it is one of a dict's sub schemas
+ */
+typedef struct bencode_schema_s
+{
+    /* NULL unless this describes a dict key's value */
+    const char *key;
+    int klen;
+    int type;
+    int flags;
+
+    /* bounds on an int's value, or on a string or list's length; each is
+     * only checked if its BENCODE_SCHEMA_MIN/MAX flag is set */
+    long int min;
+    long int max;
+
+    /* a string's length has to be a multiple of this; 0 for any length */
+    int multiple;
+
+    /* at most 64 for a dict */
+    const struct bencode_schema_s *sub;
+    int nsub;
+} bencode_schema_t;
+
+#define BENCODE_SCHEMA(key, type, flags) \
+    { key, sizeof(key) - 1, type, flags, 0, 0, 0, NULL, 0 }
+
+#define BENCODE_SCHEMA_SUB(key, type, flags, sub) \
+    { key, sizeof(key) - 1, type, flags, 0, 0, 0, \
+      sub, sizeof(sub) / sizeof((sub)[0]) }
+
+/**
+* Validate a buffer against a schema in a single pass.
+* This replaces bencode_validate followed by a walk to check the shape.
+* @param buf Buffer holding a single bencoded value
+* @param len Length of buffer
+* @param schema The root value's schema
+* @param err Set to where the buffer stopped matching; can be NULL
+* @return 0 if the buffer is well formed and matches; otherwise -1
+*/
+int bencode_schema_validate(
+    char *buf,
+    int len,
+    const bencode_schema_t * schema,
+    const char **err
+);
+
+/**
+* Pull the int under one key out of every dict in a list, in a single pass.
+* Dicts without the key get 0. The list is advanced past the dicts that
+* were read, so the call can be repeated when out fills up.
+* @param be The list bencode object
+* @param key Key to extract
+* @param klen Length of key
+* @param out Array we are writing to
+* @param cap Number of elements out can hold
+* @param n Number of elements written
+* @return 1 at the end of the list; 0 if out is full; -1 on invalid input
+*/
+int bencode_list_extract_int(
+    bencode_t * be,
+    const char *key,
+    int klen,
+    long int *out,
+    int cap,
+    int *n
+);
+
+/**
+* Pull the value under one key out of every dict in a list, in a single pass.
+* String values are given as their contents; other values are given as
+* their raw bencoded bytes. Dicts without the key get a NULL span.
+* Otherwise this behaves like bencode_list_extract_int.
+* @return 1 at the end of the list; 0 if out is full; -1 on invalid input
+*/
+int bencode_list_extract_span(
+    bencode_t * be,
+    const char *key,
+    int klen,
+    bencode_span_t * out,
+    int cap,
+    int *n
+);
+
+/**
+* Decode a list made up entirely of ints into an array, in one tight loop.
+* The list is advanced past the ints that were read, so the call can be
+* repeated when out fills up.
+* @param be The list bencode object
+* @param out Array we are writing to
+* @param cap Number of elements out can hold
+* @param n Number of elements written
+* @return 1 at the end of the list; 0 if out is full; -1 on invalid input,
+*  including list items that aren't ints
+*/
+int bencode_list_to_int64_array(
+    bencode_t * be,
+    int64_t *out,
+    int cap,
+    int *n
+);
+
+/**
+ * Parse cost accounting.
+ * Only collected when the library is built with BENCODE_STATS (make STATS=1).
+ * Values and depth are counted by bencode_validate; bytes touched and
+ * rescans are counted by every call that skips over values.
+ */
+typedef struct
+{
+    /* bytes handed to bencode_validate */
+    long int input_bytes;
+
+    /* bytes spanned each time a value had to be skipped over, plus the
+     * keys and container delimiters read while iterating */
+    long int bytes_touched;
+
+    /* number of times a value had to be skipped over */
+    long int rescans;
+
+    int max_depth;
+
+    long int ints;
+    long int strings;
+    long int lists;
+    long int dicts;
+} bencode_stats_t;
+
+/**
+* Zero the stats and start collecting them for the calling thread.
+* @param stats Stats we are collecting into
+* @return 0 on success; -1 if the library was built without BENCODE_STATS
+*/
+int bencode_stats_begin(
+    bencode_stats_t * stats
+);
+
+/**
+* Stop collecting stats for the calling thread.
+*/
+void bencode_stats_end(
+    void
+);
+
+/**
+* @return bytes touched per byte of input; 0 if there was no input
+*/
+double bencode_stats_work_ratio(
+    const bencode_stats_t * stats
+);
+
+#ifndef BENCODE_KEYSET_MAX_SLOTS
+#define BENCODE_KEYSET_MAX_SLOTS 256
+#endif
+
+/**
+ * Perfect hash over a fixed set of keys, so a key can be turned into a small
+ * integer ID with one hash and one memcmp.
+ */
+typedef struct
+{
+    const char *const *keys;
+    int nkeys;
+
+    /* length of each key, so lookups needn't stop at a NUL */
+    int lens[BENCODE_KEYSET_MAX_SLOTS / 2];
+
+    uint32_t seed;
+    uint32_t mask;
+
+    /* key ID for each slot; -1 if empty */
+    int16_t slots[BENCODE_KEYSET_MAX_SLOTS];
+} bencode_keyset_t;
+
+/**
+* Build a perfect hash over a set of keys.
+* A key's ID is its position in keys, so an enum declared in the same order
+* can be switched on.
+* @param ks The key set
+* @param keys NUL terminated keys; must outlive the key set
+* @param nkeys Number of keys
+* @return 0 on success; -1 if there are duplicate or too many keys
+*/
+int bencode_keyset_init(
+    bencode_keyset_t * ks,
+    const char *const *keys,
+    int nkeys
+);
+
+/**
+* @return the key's ID; otherwise -1 if the key isn't in the set
+*/
+int bencode_keyset_lookup(
+    const bencode_keyset_t * ks,
+    const char *key,
+    int klen
+);
+
+/**
+* Get the next item within this dictionary, along with its key's ID.
+* @param be_item Next item; can be NULL
+* @param key Key of the next item; can be NULL
+* @param klen Length of the key of the next item; can be NULL
+* @param ks Key set to look the key up in
+* @param id The key's ID; -1 if the key isn't in the set
+* @return 1 on success; otherwise 0
+*/
+int bencode_dict_get_next_id(
+    bencode_t * be,
+    bencode_t * be_item,
+    const char **key,
+    int *klen,
+    const bencode_keyset_t * ks,
+    int *id
+);
+
+#ifdef BENCODE_HEADER_ONLY
+#include "bencode_inline.h"
+#endif
+
 #endif /* BENCODE_H_ */
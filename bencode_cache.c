@@ -0,0 +1,240 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Cache of parse results keyed by content hash
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <string.h>
+
+#include "bencode.h"
+#include "bencode_cache.h"
+
+#define ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND(v0, v1, v2, v3) do { \
+    v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32); \
+    v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32); \
+} while (0)
+
+/**
+ * SipHash-2-4 of the buffer.
+ * A hit is trusted without looking at the buffer again, and the sindex
+ * lookups trust a cached index, so the hash has to be one that can't be
+ * made to collide without knowing the key. */
+static uint64_t __hash(
+    const uint64_t * key,
+    const char *buf,
+    int len
+)
+{
+    uint64_t v0 = key[0] ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = key[1] ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = key[0] ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = key[1] ^ 0x7465646279746573ULL;
+    uint64_t w;
+    int i;
+
+    for (i = 0; i + 8 <= len; i += 8)
+    {
+        memcpy(&w, buf + i, 8);
+        v3 ^= w;
+        SIPROUND(v0, v1, v2, v3);
+        SIPROUND(v0, v1, v2, v3);
+        v0 ^= w;
+    }
+
+    w = 0;
+    memcpy(&w, buf + i, len - i);
+    w |= (uint64_t)len << 56;
+    v3 ^= w;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    v0 ^= w;
+
+    v2 ^= 0xff;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static bencode_cache_entry_t *__entry(
+    bencode_cache_t * cache,
+    uint64_t h
+)
+{
+    return &cache->entries[h % cache->nentries];
+}
+
+/**
+ * Copy an entry out, along with its index if mem is given.
+ * @return 1 if the entry matched and was read consistently; otherwise 0 */
+static int __lookup(
+    bencode_cache_t * cache,
+    uint64_t h,
+    int len,
+    bencode_cache_entry_t * out,
+    void *mem,
+    size_t memlen
+)
+{
+    bencode_cache_entry_t *e;
+    uint64_t seq;
+
+    if (0 == cache->nentries)
+        return 0;
+
+    e = __entry(cache, h);
+    seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+    if (0 == seq || (seq & 1))
+        return 0;
+
+    out->hash = __atomic_load_n(&e->hash, __ATOMIC_RELAXED);
+    out->len = __atomic_load_n(&e->len, __ATOMIC_RELAXED);
+    out->valid = __atomic_load_n(&e->valid, __ATOMIC_RELAXED);
+    out->nvalues = __atomic_load_n(&e->nvalues, __ATOMIC_RELAXED);
+    out->memlen = __atomic_load_n(&e->memlen, __ATOMIC_RELAXED);
+
+    if (out->hash != h || out->len != len)
+        return 0;
+
+    if (mem)
+    {
+        if (0 == out->memlen || memlen < out->memlen)
+            return 0;
+        memcpy(mem, cache->slots + (h % cache->nentries) * cache->slotlen,
+               out->memlen);
+    }
+
+    /* a writer got in while we were reading */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return seq == __atomic_load_n(&e->seq, __ATOMIC_RELAXED);
+}
+
+static void __store(
+    bencode_cache_t * cache,
+    uint64_t h,
+    int len,
+    int valid,
+    const bencode_sindex_t * idx
+)
+{
+    bencode_cache_entry_t *e;
+    uint64_t seq;
+
+    if (0 == cache->nentries)
+        return;
+
+    e = __entry(cache, h);
+    seq = __atomic_load_n(&e->seq, __ATOMIC_RELAXED);
+
+    /* an index over only part of the buffer can't be attached later */
+    if (idx && (!cache->slots || cache->slotlen < idx->memlen ||
+                idx->len != len))
+        idx = NULL;
+
+    /* someone else is writing; dropping a cache insert is harmless */
+    if ((seq & 1) ||
+        !__atomic_compare_exchange_n(&e->seq, &seq, seq + 1, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    __atomic_store_n(&e->hash, h, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->len, len, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->valid, valid, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->nvalues, idx ? idx->nvalues : 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->memlen, idx ? idx->memlen : 0, __ATOMIC_RELAXED);
+    if (idx)
+        memcpy(cache->slots + (h % cache->nentries) * cache->slotlen,
+               idx->mem, idx->memlen);
+
+    __atomic_store_n(&e->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void bencode_cache_init(
+    bencode_cache_t * cache,
+    bencode_cache_entry_t * entries,
+    int nentries,
+    void *slots,
+    size_t slotlen,
+    const uint64_t * key
+)
+{
+    /* an empty cache never hits */
+    if (nentries < 0)
+        nentries = 0;
+    memset(entries, 0, sizeof(bencode_cache_entry_t) * nentries);
+    cache->entries = entries;
+    cache->nentries = nentries;
+    cache->slots = slots;
+    /* keep every slot aligned for uint64_t */
+    cache->slotlen = slotlen & ~(size_t)7;
+    cache->key[0] = key[0];
+    cache->key[1] = key[1];
+}
+
+int bencode_cache_validate(
+    bencode_cache_t * cache,
+    char *buf,
+    int len
+)
+{
+    bencode_cache_entry_t e;
+    uint64_t h = __hash(cache->key, buf, len);
+    int valid;
+
+    if (__lookup(cache, h, len, &e, NULL, 0))
+        return e.valid ? 0 : -1;
+
+    valid = 0 == bencode_validate(buf, len);
+    __store(cache, h, len, valid, NULL);
+    return valid ? 0 : -1;
+}
+
+int bencode_cache_index(
+    bencode_cache_t * cache,
+    bencode_sindex_t * idx,
+    void *mem,
+    size_t memlen,
+    char *buf,
+    int len
+)
+{
+    bencode_cache_entry_t e;
+    uint64_t h = __hash(cache->key, buf, len);
+
+    if (__lookup(cache, h, len, &e, mem, memlen))
+    {
+        if (!e.valid)
+            return -1;
+        return bencode_sindex_attach(idx, mem, memlen, buf, len, e.nvalues);
+    }
+
+    /* the buffer may already be known to be valid or invalid */
+    if (__lookup(cache, h, len, &e, NULL, 0))
+    {
+        if (!e.valid)
+            return -1;
+    }
+    else if (0 != bencode_validate(buf, len))
+    {
+        __store(cache, h, len, 0, NULL);
+        return -1;
+    }
+
+    if (0 != bencode_sindex_build(idx, mem, memlen, buf, len))
+        return -1;
+
+    __store(cache, h, len, 1, idx);
+    return 0;
+}
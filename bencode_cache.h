@@ -0,0 +1,97 @@
+#ifndef BENCODE_CACHE_H_
+#define BENCODE_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bencode_sindex.h"
+
+typedef struct
+{
+    /* odd while the entry is being written */
+    uint64_t seq;
+
+    uint64_t hash;
+    long int len;
+
+    /* 1 if the buffer validated; 0 if it didn't */
+    int valid;
+
+    /* index details; memlen is 0 if no index is cached */
+    long int nvalues;
+    size_t memlen;
+} bencode_cache_entry_t;
+
+/**
+ * Fixed-size cache of parse results, keyed by a SipHash of the buffer's
+ * contents. A buffer seen before skips validation and indexing.
+ *
+ * Entries are guarded by sequence counters, so any number of threads can
+ * look up and insert at once without locks. A writer that finds an entry
+ * busy simply doesn't cache its result.
+ *
+ * All memory is handed over by the caller.
+ */
+typedef struct
+{
+    bencode_cache_entry_t *entries;
+    int nentries;
+
+    /* index memory; slotlen bytes for each entry */
+    char *slots;
+    size_t slotlen;
+
+    /* SipHash key */
+    uint64_t key[2];
+} bencode_cache_t;
+
+/**
+* Set up a cache.
+* @param cache The cache
+* @param entries Memory for the entries
+* @param nentries Number of entries
+* @param slots Memory for cached indexes, aligned for uint64_t; NULL if
+*  indexes aren't to be cached
+* @param slotlen Bytes of slots per entry; indexes larger than this aren't
+*  cached
+* @param key 128 bit SipHash key. A hit is trusted without looking at the
+*  buffer again, so this has to be random and secret when buffers are
+*  untrusted; a known key lets collisions be crafted
+*/
+void bencode_cache_init(
+    bencode_cache_t * cache,
+    bencode_cache_entry_t * entries,
+    int nentries,
+    void *slots,
+    size_t slotlen,
+    const uint64_t * key
+);
+
+/**
+* Validate a buffer, using the cached result if it has been seen before.
+* @return 0 if valid; otherwise -1
+*/
+int bencode_cache_validate(
+    bencode_cache_t * cache,
+    char *buf,
+    int len
+);
+
+/**
+* Validate a buffer and build its index, using the cached index if the
+* buffer has been seen before.
+* @param idx The index we are setting up
+* @param mem Memory for the index, aligned for uint64_t
+* @param memlen Length of mem
+* @return 0 on success; -1 if the buffer is invalid or mem is too small
+*/
+int bencode_cache_index(
+    bencode_cache_t * cache,
+    bencode_sindex_t * idx,
+    void *mem,
+    size_t memlen,
+    char *buf,
+    int len
+);
+
+#endif /* BENCODE_CACHE_H_ */
@@ -0,0 +1,123 @@
+#ifndef BENCODE_CURSOR_H_
+#define BENCODE_CURSOR_H_
+
+/**
+ * Internal helpers for walking the children of two containers side by side,
+ * as merging and diffing do. Not part of the public API.
+ */
+
+#include <string.h>
+
+#include "bencode.h"
+
+/**
+ * A child of a container. The container has always moved on to the next
+ * child, so its position is where the current child ends.
+ */
+typedef struct
+{
+    bencode_t container;
+    bencode_t item;
+
+    /* key of a dict's child; NULL within a list */
+    const char *key;
+    int klen;
+
+    /* position within a list */
+    int pos;
+
+    int is_dict;
+
+    /* 1 if there is a current child */
+    int has;
+} bencode_cursor_t;
+
+static inline void __bencode_cursor_init(
+    bencode_cursor_t * c,
+    bencode_t * container
+)
+{
+    memset(c, 0, sizeof(bencode_cursor_t));
+    bencode_clone(container, &c->container);
+    c->is_dict = bencode_is_dict(container);
+    c->pos = -1;
+}
+
+/**
+ * Move on to the next child
+ * @return 0 on success, including at the end; -1 on invalid input */
+static inline int __bencode_cursor_next(
+    bencode_cursor_t * c
+)
+{
+    c->has = 0;
+
+    if (c->is_dict)
+    {
+        if (!bencode_dict_has_next(&c->container))
+            return 0;
+        if (0 == bencode_dict_get_next(&c->container, &c->item, &c->key,
+                                       &c->klen))
+            return -1;
+    }
+    else
+    {
+        if (!bencode_list_has_next(&c->container))
+            return 0;
+        if (1 != bencode_list_get_next(&c->container, &c->item))
+            return -1;
+        c->pos++;
+    }
+
+    c->has = 1;
+    return 0;
+}
+
+/**
+ * @return one past the end of the current child */
+static inline const char *__bencode_cursor_end(
+    const bencode_cursor_t * c
+)
+{
+    return c->container.str;
+}
+
+/**
+ * Order keys the way canonical dicts sort them: as raw bytes, with a
+ * prefix first */
+static inline int __bencode_keycmp(
+    const char *a,
+    int alen,
+    const char *b,
+    int blen
+)
+{
+    int ret = memcmp(a, b, alen < blen ? alen : blen);
+
+    if (0 != ret)
+        return ret;
+    return alen - blen;
+}
+
+/**
+ * Find where a container ends, once it has been iterated over
+ * @return pointer to one past the terminating 'e'; NULL if the container
+ *  isn't terminated within the buffer */
+static inline const char *__bencode_container_end(
+    const bencode_t * c
+)
+{
+    const char *end = c->start + c->len;
+    const char *sp = c->str;
+
+    /* an empty dict leaves us on the 'd' */
+    if (0 < c->len && sp == c->start && *sp == 'd')
+        sp++;
+
+    if (!sp || end <= sp || *sp != 'e')
+        return NULL;
+
+    return sp + 1;
+}
+
+#endif /* BENCODE_CURSOR_H_ */
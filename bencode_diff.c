@@ -0,0 +1,181 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Structural diff of two bencoded documents
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <string.h>
+
+#include "bencode_diff.h"
+#include "bencode_cursor.h"
+
+typedef struct
+{
+    bencode_diff_cb cb;
+    void *udata;
+    int changes;
+    bencode_path_t path[BENCODE_DIFF_MAX_DEPTH];
+} diff_t;
+
+/**
+ * @return the span of the cursor's current item */
+static bencode_span_t __cursor_span(
+    const bencode_cursor_t * c
+)
+{
+    bencode_span_t s;
+
+    s.str = c->item.str;
+    s.len = __bencode_cursor_end(c) - c->item.str;
+    return s;
+}
+
+static void __report(
+    diff_t * d,
+    int change,
+    int depth,
+    const bencode_span_t * a,
+    const bencode_span_t * b
+)
+{
+    d->changes++;
+    d->cb(d->udata, change, d->path, depth, a, b);
+}
+
+static int __diff(
+    diff_t * d,
+    bencode_t * a,
+    const bencode_span_t * as,
+    bencode_t * b,
+    const bencode_span_t * bs,
+    int depth
+);
+
+/**
+ * Compare the children of two dicts or two lists
+ * @return 0 on success; -1 on invalid input */
+static int __diff_children(
+    diff_t * d,
+    bencode_t * a,
+    bencode_t * b,
+    int depth
+)
+{
+    bencode_cursor_t ca, cb;
+
+    __bencode_cursor_init(&ca, a);
+    __bencode_cursor_init(&cb, b);
+
+    if (-1 == __bencode_cursor_next(&ca) ||
+        -1 == __bencode_cursor_next(&cb))
+        return -1;
+
+    while (ca.has || cb.has)
+    {
+        bencode_span_t as, bs;
+        int cmp;
+
+        if (!cb.has)
+            cmp = -1;
+        else if (!ca.has)
+            cmp = 1;
+        else if (ca.key)
+            cmp = __bencode_keycmp(ca.key, ca.klen, cb.key, cb.klen);
+        else
+            cmp = 0;
+
+        if (ca.has)
+            as = __cursor_span(&ca);
+        if (cb.has)
+            bs = __cursor_span(&cb);
+
+        /* the path to this child */
+        d->path[depth].key = cmp <= 0 ? ca.key : cb.key;
+        d->path[depth].len = cmp <= 0 ?
+            (ca.key ? ca.klen : ca.pos) : (cb.key ? cb.klen : cb.pos);
+
+        if (cmp < 0)
+        {
+            __report(d, BENCODE_DIFF_REMOVED, depth + 1, &as, NULL);
+            if (-1 == __bencode_cursor_next(&ca))
+                return -1;
+        }
+        else if (0 < cmp)
+        {
+            __report(d, BENCODE_DIFF_ADDED, depth + 1, NULL, &bs);
+            if (-1 == __bencode_cursor_next(&cb))
+                return -1;
+        }
+        else
+        {
+            if (-1 == __diff(d, &ca.item, &as, &cb.item, &bs, depth + 1))
+                return -1;
+            if (-1 == __bencode_cursor_next(&ca) ||
+                -1 == __bencode_cursor_next(&cb))
+                return -1;
+        }
+    }
+
+    if (!__bencode_container_end(&ca.container) ||
+        !__bencode_container_end(&cb.container))
+        return -1;
+
+    return 0;
+}
+
+static int __diff(
+    diff_t * d,
+    bencode_t * a,
+    const bencode_span_t * as,
+    bencode_t * b,
+    const bencode_span_t * bs,
+    int depth
+)
+{
+    /* identical subtrees */
+    if (as->len == bs->len && 0 == memcmp(as->str, bs->str, as->len))
+        return 0;
+
+    if (depth < BENCODE_DIFF_MAX_DEPTH &&
+        ((bencode_is_dict(a) && bencode_is_dict(b)) ||
+         (bencode_is_list(a) && bencode_is_list(b))))
+        return __diff_children(d, a, b, depth);
+
+    __report(d, BENCODE_DIFF_CHANGED, depth, as, bs);
+    return 0;
+}
+
+int bencode_diff(
+    bencode_t * a,
+    bencode_t * b,
+    bencode_diff_cb cb,
+    void *udata
+)
+{
+    diff_t d;
+    bencode_span_t as, bs;
+
+    d.cb = cb;
+    d.udata = udata;
+    d.changes = 0;
+
+    if (!(as.str = bencode_value_end(a)) || !(bs.str = bencode_value_end(b)))
+        return -1;
+
+    /* the roots end where their value does, not at the end of the buffer */
+    as.len = as.str - a->str;
+    as.str = a->str;
+    bs.len = bs.str - b->str;
+    bs.str = b->str;
+
+    if (-1 == __diff(&d, a, &as, b, &bs, 0))
+        return -1;
+
+    return d.changes;
+}
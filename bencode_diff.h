@@ -0,0 +1,68 @@
+#ifndef BENCODE_DIFF_H_
+#define BENCODE_DIFF_H_
+
+#include "bencode.h"
+
+#ifndef BENCODE_DIFF_MAX_DEPTH
+#define BENCODE_DIFF_MAX_DEPTH 64
+#endif
+
+enum {
+    /** the path is only in the second document */
+    BENCODE_DIFF_ADDED,
+    /** the path is only in the first document */
+    BENCODE_DIFF_REMOVED,
+    /** the path is in both documents with different values */
+    BENCODE_DIFF_CHANGED
+};
+
+/**
+ * One step of a path into a document
+ */
+typedef struct
+{
+    /* dict key; NULL if this step is a position within a list */
+    const char *key;
+
+    /* length of key, or position within the list */
+    int len;
+} bencode_path_t;
+
+/**
+* Called for each difference.
+* @param udata User data given to bencode_diff
+* @param change BENCODE_DIFF_* kind of change
+* @param path Steps from the root to the value
+* @param depth Number of steps in path
+* @param a The value in the first document; NULL if it was added
+* @param b The value in the second document; NULL if it was removed
+*/
+typedef void (*bencode_diff_cb)(
+    void *udata,
+    int change,
+    const bencode_path_t * path,
+    int depth,
+    const bencode_span_t * a,
+    const bencode_span_t * b
+);
+
+/**
+* Walk two documents in lockstep and report the paths that differ.
+* Dicts are compared key by key, relying on keys being sorted, and lists
+* position by position. Subtrees whose raw bytes are identical are skipped
+* with a memcmp. Values deeper than BENCODE_DIFF_MAX_DEPTH are reported as
+* changed as a whole.
+* @param a The first document, holding a single value
+* @param b The second document, holding a single value
+* @param cb Callback for each difference
+* @param udata User data passed to cb
+* @return number of differences; -1 on invalid input
+*/
+int bencode_diff(
+    bencode_t * a,
+    bencode_t * b,
+    bencode_diff_cb cb,
+    void *udata
+);
+
+#endif /* BENCODE_DIFF_H_ */
@@ -0,0 +1,101 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Hand string values over to file descriptors without copying
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include "bencode_fd.h"
+
+int bencode_string_iovec(
+    bencode_t * be,
+    struct iovec *iov
+)
+{
+    const char *str;
+    int len;
+
+    iov->iov_base = NULL;
+    iov->iov_len = 0;
+
+    if (!bencode_is_string(be))
+        return 0;
+
+    if (0 == bencode_string_value(be, &str, &len))
+        return 0;
+
+    iov->iov_base = (void *)str;
+    iov->iov_len = len;
+    return 1;
+}
+
+long int bencode_string_sendfile(
+    bencode_t * be,
+    const char *base,
+    int in_fd,
+    int out_fd,
+    long int skip
+)
+{
+    const char *str;
+    long int sent = 0;
+    int len;
+
+    if (!bencode_is_string(be) || 0 == bencode_string_value(be, &str, &len))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (skip < 0 || len < skip)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    str += skip;
+    len -= skip;
+
+    while (sent < len)
+    {
+        ssize_t n;
+
+#ifdef __linux__
+        off_t off = str - base + sent;
+
+        n = sendfile(out_fd, in_fd, &off, len - sent);
+#else
+        (void)in_fd;
+        n = write(out_fd, str + sent, len - sent);
+#endif
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            /* the caller can resume once the descriptor is writable */
+            if (errno == EAGAIN && 0 < sent)
+                break;
+            return -1;
+        }
+
+        if (0 == n)
+            break;
+
+        sent += n;
+    }
+
+    return sent;
+}
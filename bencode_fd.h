@@ -0,0 +1,39 @@
+#ifndef BENCODE_FD_H_
+#define BENCODE_FD_H_
+
+#include <sys/uio.h>
+
+#include "bencode.h"
+
+/**
+* Point an iovec at the bytes of a string value, ready for writev.
+* @param be The string bencode object
+* @param iov The iovec we are writing to
+* @return 1 on success; otherwise 0
+*/
+int bencode_string_iovec(
+    bencode_t * be,
+    struct iovec *iov
+);
+
+/**
+* Send the bytes of a string value from the file it was mmapped from
+* straight to another file descriptor, without copying them through user
+* space. Uses sendfile where available; otherwise writes from the mapping.
+* @param be The string bencode object, within the mapping
+* @param base Start of the mapping
+* @param in_fd File descriptor of the mapped file
+* @param out_fd File descriptor we are sending to, eg. a socket
+* @param skip Number of bytes of the string already sent, so a partial send
+*  on a non-blocking descriptor can be resumed
+* @return number of bytes sent by this call; -1 on error
+*/
+long int bencode_string_sendfile(
+    bencode_t * be,
+    const char *base,
+    int in_fd,
+    int out_fd,
+    long int skip
+);
+
+#endif /* BENCODE_FD_H_ */
@@ -0,0 +1,120 @@
+#ifndef BENCODE_INLINE_H_
+#define BENCODE_INLINE_H_
+
+/**
+ * Definitions of the hot predicates.
+ * Included by bencode.c, and by bencode.h when BENCODE_HEADER_ONLY is
+ * defined.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+
+#include "bencode.h"
+
+/**
+ * @return 1 if there is a byte to read at this position; otherwise 0 */
+static inline int __bencode_readable(
+    const bencode_t * be,
+    const char *sp
+)
+{
+    return sp && sp < be->start + be->len;
+}
+
+BENCODE_INLINE int bencode_is_dict(
+    const bencode_t * be
+)
+{
+    return __bencode_readable(be, be->str) && *be->str == 'd';
+}
+
+BENCODE_INLINE int bencode_is_int(
+    const bencode_t * be
+)
+{
+    return __bencode_readable(be, be->str) && *be->str == 'i';
+}
+
+BENCODE_INLINE int bencode_is_list(
+    const bencode_t * be
+)
+{
+    return __bencode_readable(be, be->str) && *be->str == 'l';
+}
+
+BENCODE_INLINE int bencode_is_string(
+    const bencode_t * be
+)
+{
+    const char *sp;
+
+    sp = be->str;
+
+    assert(sp);
+
+    if (!__bencode_readable(be, sp) || !isdigit(*sp))
+        return 0;
+
+    do sp++;
+    while (__bencode_readable(be, sp) && isdigit(*sp));
+
+    return __bencode_readable(be, sp) && *sp == ':';
+}
+
+BENCODE_INLINE int bencode_dict_has_next(
+    bencode_t * be
+)
+{
+    const char *sp = be->str;
+
+    assert(be);
+
+    if (!__bencode_readable(be, sp)
+        /* at end of dict */
+        || *sp == 'e'
+        /* at end of string */
+        || *sp == '\0'
+        || *sp == '\r'
+        /* at the end of the input string */
+        || sp >= be->start + be->len - 1
+        /* empty dict */
+        || (*sp == 'd' && *(sp + 1) == 'e'))
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+BENCODE_INLINE int bencode_list_has_next(
+    bencode_t * be
+)
+{
+    const char *sp;
+
+    sp = be->str;
+
+    if (!__bencode_readable(be, sp))
+        return 0;
+
+    /* empty list */
+    if (*sp == 'l' &&
+        sp == be->start &&
+        __bencode_readable(be, sp + 1) &&
+        *(sp + 1) == 'e')
+    {
+        be->str++;
+        return 0;
+    }
+
+    /* end of list */
+    if (*sp == 'e')
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+#endif /* BENCODE_INLINE_H_ */
@@ -0,0 +1,274 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Read bencoded data that is spread over several buffers
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <limits.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "bencode_iov.h"
+
+void bencode_iov_init(
+    bencode_iov_t * it,
+    const struct iovec *iov,
+    int iovcnt,
+    char *scratch,
+    int scratchlen
+)
+{
+    memset(it, 0, sizeof(bencode_iov_t));
+    it->iov = iov;
+    it->iovcnt = iovcnt;
+    it->scratch = scratch;
+    it->scratchlen = scratchlen;
+}
+
+/**
+ * Move past any exhausted segments
+ * @return 1 if there is input left; otherwise 0 */
+static int __have_input(
+    bencode_iov_t * it
+)
+{
+    while (it->seg < it->iovcnt && it->off == it->iov[it->seg].iov_len)
+    {
+        it->seg++;
+        it->off = 0;
+    }
+
+    return it->seg < it->iovcnt;
+}
+
+/**
+ * @return next byte; otherwise -1 at the end of input */
+static int __peek(
+    bencode_iov_t * it
+)
+{
+    if (!__have_input(it))
+        return -1;
+    /* unsigned, so that 0xff isn't mistaken for the end */
+    return ((const unsigned char *)it->iov[it->seg].iov_base)[it->off];
+}
+
+static int __getc(
+    bencode_iov_t * it
+)
+{
+    int c = __peek(it);
+
+    if (-1 != c)
+        it->off++;
+    return c;
+}
+
+static int __read_int(
+    bencode_iov_t * it,
+    bencode_iov_token_t * tok
+)
+{
+    unsigned long int v = 0;
+    int c, neg = 0;
+
+    tok->val = 0;
+
+    c = __getc(it);
+    if (c == '-')
+    {
+        neg = 1;
+        c = __getc(it);
+    }
+
+    if (-1 == c || !isdigit(c))
+        return -1;
+
+    do
+    {
+        /* the same range as __read_string_int; LONG_MIN is allowed */
+        if (((unsigned long int)LONG_MAX + neg - (c - '0')) / 10 < v)
+            return -1;
+        v = v * 10 + c - '0';
+        c = __getc(it);
+    }
+    while (-1 != c && isdigit(c));
+
+    if (c != 'e')
+        return -1;
+
+    tok->val = neg ? (long int)(0 - v) : (long int)v;
+    return 0;
+}
+
+/**
+ * Copy the string into the scratch space, as it spans too many segments */
+static int __copy_string(
+    bencode_iov_t * it,
+    bencode_iov_token_t * tok,
+    long int slen
+)
+{
+    long int got = 0;
+
+    if (it->scratchlen < slen)
+        return -1;
+
+    while (got < slen)
+    {
+        size_t n;
+
+        if (!__have_input(it))
+            return -1;
+
+        n = it->iov[it->seg].iov_len - it->off;
+        if ((size_t)(slen - got) < n)
+            n = slen - got;
+
+        memcpy(it->scratch + got,
+               (const char *)it->iov[it->seg].iov_base + it->off, n);
+        it->off += n;
+        got += n;
+    }
+
+    tok->str[0] = it->scratch;
+    tok->len[0] = slen;
+    return 0;
+}
+
+static int __read_string(
+    bencode_iov_t * it,
+    bencode_iov_token_t * tok,
+    int c
+)
+{
+    long int slen = 0;
+    int part, seg;
+    size_t off;
+
+    do
+    {
+        if (slen > (INT_MAX - 9) / 10)
+            return -1;
+        slen = slen * 10 + c - '0';
+        c = __getc(it);
+    }
+    while (-1 != c && isdigit(c));
+
+    if (c != ':')
+        return -1;
+
+    tok->len[0] = tok->len[1] = 0;
+    tok->str[0] = tok->str[1] = NULL;
+
+    if (0 == slen)
+    {
+        tok->str[0] = "";
+        return 0;
+    }
+
+    seg = it->seg;
+    off = it->off;
+
+    /* try to point at the string with at most two parts */
+    for (part = 0; part < 2 && __have_input(it); part++)
+    {
+        size_t n = it->iov[it->seg].iov_len - it->off;
+
+        if ((size_t)slen < n)
+            n = slen;
+
+        tok->str[part] = (const char *)it->iov[it->seg].iov_base + it->off;
+        tok->len[part] = n;
+        it->off += n;
+        slen -= n;
+
+        if (0 == slen)
+            return 0;
+    }
+
+    /* start again and copy */
+    slen += tok->len[0] + tok->len[1];
+    it->seg = seg;
+    it->off = off;
+    tok->len[1] = 0;
+    return __copy_string(it, tok, slen);
+}
+
+/**
+ * A value has been completely read; work out what we expect next */
+static void __value_end(
+    bencode_iov_t * it
+)
+{
+    if (0 == it->depth)
+        it->done = 1;
+    else if (it->stack[it->depth - 1] == 'k')
+        it->stack[it->depth - 1] = 'v';
+    else if (it->stack[it->depth - 1] == 'v')
+        it->stack[it->depth - 1] = 'k';
+}
+
+int bencode_iov_next(
+    bencode_iov_t * it,
+    bencode_iov_token_t * tok
+)
+{
+    char top;
+    int c;
+
+    if (it->done)
+        return 0;
+
+    c = __getc(it);
+    if (-1 == c)
+        return -1;
+
+    top = 0 < it->depth ? it->stack[it->depth - 1] : 0;
+
+    /* dict keys have to be strings */
+    if (top == 'k' && c != 'e' && !isdigit(c))
+        return -1;
+
+    if (isdigit(c))
+    {
+        tok->type = BENCODE_IOV_STRING;
+        if (-1 == __read_string(it, tok, c))
+            return -1;
+        __value_end(it);
+        return 1;
+    }
+
+    switch (c)
+    {
+    case 'i':
+        tok->type = BENCODE_IOV_INT;
+        if (-1 == __read_int(it, tok))
+            return -1;
+        __value_end(it);
+        return 1;
+    case 'l':
+    case 'd':
+        if (BENCODE_IOV_MAX_DEPTH == it->depth)
+            return -1;
+        tok->type = c == 'l' ? BENCODE_IOV_LIST : BENCODE_IOV_DICT;
+        it->stack[it->depth++] = c == 'l' ? 'l' : 'k';
+        return 1;
+    case 'e':
+        /* a dict key is missing its value */
+        if (0 == it->depth || top == 'v')
+            return -1;
+        tok->type = BENCODE_IOV_END;
+        it->depth--;
+        __value_end(it);
+        return 1;
+    }
+
+    return -1;
+}
@@ -0,0 +1,87 @@
+#ifndef BENCODE_IOV_H_
+#define BENCODE_IOV_H_
+
+#include <sys/uio.h>
+
+#ifndef BENCODE_IOV_MAX_DEPTH
+#define BENCODE_IOV_MAX_DEPTH 64
+#endif
+
+enum {
+    BENCODE_IOV_INT,
+    BENCODE_IOV_STRING,
+    BENCODE_IOV_LIST,
+    BENCODE_IOV_DICT,
+    /** end of a list or dict */
+    BENCODE_IOV_END
+};
+
+typedef struct
+{
+    int type;
+
+    /* value of an int */
+    long int val;
+
+    /* A string is returned in up to two parts. The second part is only used
+     * when the string straddles a segment boundary, otherwise len[1] is 0 */
+    const char *str[2];
+    int len[2];
+} bencode_iov_token_t;
+
+/**
+ * Reads bencoded data that is spread over several buffers.
+ */
+typedef struct
+{
+    const struct iovec *iov;
+    int iovcnt;
+
+    /* current segment, and position within it */
+    int seg;
+    size_t off;
+
+    /* strings spanning more than two segments are copied here */
+    char *scratch;
+    int scratchlen;
+
+    /* set once the top level value has been read */
+    int done;
+
+    int depth;
+
+    /* 'l' for list; 'k' or 'v' for dict expecting a key or a value */
+    char stack[BENCODE_IOV_MAX_DEPTH];
+} bencode_iov_t;
+
+/**
+* Initialise a reader over a chain of buffers.
+* @param it The reader
+* @param iov Buffers holding the input, in order
+* @param iovcnt Number of buffers
+* @param scratch Space for strings that span more than two buffers; can be NULL
+* @param scratchlen Length of scratch
+*/
+void bencode_iov_init(
+    bencode_iov_t * it,
+    const struct iovec *iov,
+    int iovcnt,
+    char *scratch,
+    int scratchlen
+);
+
+/**
+* Read the next token.
+* Lists and dicts are returned as a start token, their contents, and then an
+* BENCODE_IOV_END token. Dict keys are returned as strings.
+* @param it The reader
+* @param tok The token we are writing to
+* @return 1 on success; 0 once the whole value has been read; -1 on invalid
+*  input, or if a string didn't fit into the scratch space
+*/
+int bencode_iov_next(
+    bencode_iov_t * it,
+    bencode_iov_token_t * tok
+);
+
+#endif /* BENCODE_IOV_H_ */
@@ -0,0 +1,560 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Load many small bencoded files at once
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#include "bencode_loader.h"
+
+typedef struct
+{
+    bencode_loader_file_t *files;
+    int nfiles;
+    char *arena;
+    size_t arenalen;
+    size_t arenaused;
+    int next;
+    bencode_loader_cb cb;
+    void *udata;
+} loader_t;
+
+/**
+ * Open the file and reserve space for it in the arena
+ * @return 0 on success; otherwise -1 with f->err set */
+static int __open(
+    loader_t * l,
+    bencode_loader_file_t * f
+)
+{
+    struct stat st;
+    size_t off;
+
+    f->buf = NULL;
+    f->len = 0;
+    f->err = 0;
+    f->got = 0;
+
+    f->fd = open(f->path, O_RDONLY);
+    if (-1 == f->fd)
+    {
+        f->err = errno;
+        return -1;
+    }
+
+    if (-1 == fstat(f->fd, &st))
+    {
+        f->err = errno;
+        goto fail;
+    }
+
+    if (0x7fffffff < st.st_size)
+    {
+        f->err = EFBIG;
+        goto fail;
+    }
+
+    /* only reserve the space if the file fits, so that one big file
+     * doesn't leave the arena looking full to the files after it */
+    off = __atomic_load_n(&l->arenaused, __ATOMIC_RELAXED);
+    do
+    {
+        if (l->arenalen - off < (size_t)st.st_size)
+        {
+            f->err = ENOSPC;
+            goto fail;
+        }
+    }
+    while (!__atomic_compare_exchange_n(&l->arenaused, &off, off + st.st_size,
+                                        1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    f->buf = l->arena + off;
+    f->len = st.st_size;
+    return 0;
+
+fail:
+    close(f->fd);
+    f->fd = -1;
+    return -1;
+}
+
+/**
+ * The file's contents are in; validate them and hand the file over */
+static void __complete(
+    loader_t * l,
+    bencode_loader_file_t * f
+)
+{
+    if (-1 != f->fd)
+    {
+        close(f->fd);
+        f->fd = -1;
+    }
+
+    if (0 == f->err && (0 == f->len || 0 != bencode_validate(f->buf, f->len)))
+        f->err = EBADMSG;
+
+    if (0 == f->err)
+        bencode_init(&f->be, f->buf, f->len);
+
+    l->cb(f, l->udata);
+}
+
+/**
+ * Read whatever hasn't been read of the file yet, with blocking reads */
+static void __read_rest(
+    bencode_loader_file_t * f
+)
+{
+    while (f->got < f->len)
+    {
+        int len = f->len - f->got < BENCODE_LOADER_MAX_READ ?
+            f->len - f->got : BENCODE_LOADER_MAX_READ;
+        ssize_t n = pread(f->fd, f->buf + f->got, len, f->got);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        if (n <= 0)
+        {
+            /* the file shrank since we looked at its size */
+            f->err = 0 == n ? EIO : errno;
+            break;
+        }
+        f->got += n;
+    }
+}
+
+static void *__worker(
+    void *arg
+)
+{
+    loader_t *l = arg;
+
+    while (1)
+    {
+        int i = __atomic_fetch_add(&l->next, 1, __ATOMIC_RELAXED);
+        bencode_loader_file_t *f;
+
+        if (l->nfiles <= i)
+            break;
+
+        f = &l->files[i];
+
+        if (0 == __open(l, f))
+            __read_rest(f);
+
+        __complete(l, f);
+    }
+
+    return NULL;
+}
+
+static int __run_threads(
+    loader_t * l,
+    int nthreads
+)
+{
+    pthread_t threads[64];
+    int i, started = 0;
+
+    if (nthreads < 1)
+        nthreads = 1;
+    if (64 < nthreads)
+        nthreads = 64;
+
+    for (i = 0; i < nthreads; i++)
+    {
+        if (0 != pthread_create(&threads[i], NULL, __worker, l))
+            break;
+        started++;
+    }
+
+    /* do the work ourselves if we couldn't start any threads */
+    if (0 == started)
+        __worker(l);
+
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    return 0;
+}
+
+#ifdef HAVE_IO_URING
+
+typedef struct
+{
+    int fd;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+} uring_t;
+
+static void __uring_teardown(
+    uring_t * r
+);
+
+/**
+ * Do a round trip with a no-op
+ * @return 0 on success; otherwise -1 */
+static int __uring_nop(
+    uring_t * r
+)
+{
+    unsigned tail = *r->sq_tail, idx = tail & *r->sq_mask, head;
+
+    memset(&r->sqes[idx], 0, sizeof(struct io_uring_sqe));
+    r->sqes[idx].opcode = IORING_OP_NOP;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    if (1 != syscall(__NR_io_uring_enter, r->fd, 1, 1,
+                     IORING_ENTER_GETEVENTS, NULL, 0))
+        return -1;
+
+    head = *r->cq_head;
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+        return -1;
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static int __uring_setup(
+    uring_t * r
+)
+{
+    struct io_uring_params p;
+    char *sq, *cq;
+
+    memset(&p, 0, sizeof(p));
+    r->fd = syscall(__NR_io_uring_setup, BENCODE_LOADER_QUEUE_DEPTH, &p);
+    if (r->fd < 0)
+        return -1;
+
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (r->sq_len < r->cq_len)
+            r->sq_len = r->cq_len;
+        r->cq_len = 0;
+    }
+
+    r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == r->sq_ptr)
+        goto fail_sq;
+
+    r->cq_ptr = r->sq_ptr;
+    if (0 != r->cq_len)
+    {
+        r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == r->cq_ptr)
+            goto fail_cq;
+    }
+
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (MAP_FAILED == r->sqes)
+        goto fail_sqes;
+
+    sq = r->sq_ptr;
+    cq = r->cq_ptr;
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    /* make sure we are actually allowed to submit, eg. under seccomp */
+    if (-1 == __uring_nop(r))
+    {
+        __uring_teardown(r);
+        return -1;
+    }
+
+    return 0;
+
+fail_sqes:
+    if (0 != r->cq_len)
+        munmap(r->cq_ptr, r->cq_len);
+fail_cq:
+    munmap(r->sq_ptr, r->sq_len);
+fail_sq:
+    close(r->fd);
+    return -1;
+}
+
+static void __uring_teardown(
+    uring_t * r
+)
+{
+    munmap(r->sqes, r->sqes_len);
+    if (0 != r->cq_len)
+        munmap(r->cq_ptr, r->cq_len);
+    munmap(r->sq_ptr, r->sq_len);
+    close(r->fd);
+}
+
+static void __uring_queue_read(
+    uring_t * r,
+    bencode_loader_file_t * f,
+    int i
+)
+{
+    unsigned tail = *r->sq_tail, idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = f->fd;
+    sqe->addr = (unsigned long)(f->buf + f->got);
+    sqe->len = f->len - f->got < BENCODE_LOADER_MAX_READ ?
+        f->len - f->got : BENCODE_LOADER_MAX_READ;
+    sqe->off = f->got;
+    sqe->user_data = i;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * The ring can't be waited on, so the kernel may still be reading into the
+ * queued files' space in the arena. Fail them without pointing at it. */
+static void __abandon_queued(
+    loader_t * l
+)
+{
+    int i;
+
+    for (i = 0; i < l->next; i++)
+    {
+        bencode_loader_file_t *f = &l->files[i];
+
+        if (-1 == f->fd)
+            continue;
+
+        f->err = EIO;
+        f->buf = NULL;
+        f->len = 0;
+    }
+}
+
+/**
+ * Wait for the reads the kernel already has, so that none of them lands in
+ * a buffer after the file has been handed back. Reads that haven't been
+ * submitted are left in the ring, which is torn down without submitting them.
+ * @return 0 once nothing is in flight; -1 if the ring can't be waited on */
+static int __uring_drain(
+    loader_t * l,
+    uring_t * r,
+    int inflight
+)
+{
+    while (0 < inflight)
+    {
+        unsigned head;
+
+        if (syscall(__NR_io_uring_enter, r->fd, 0, inflight,
+                    IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+            errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            return -1;
+
+        head = *r->cq_head;
+        while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+        {
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            bencode_loader_file_t *f = &l->files[cqe->user_data];
+
+            head++;
+            inflight--;
+
+            /* the blocking reads carry on from here */
+            if (cqe->res < 0)
+                f->err = -cqe->res;
+            else
+                f->got += cqe->res;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    return 0;
+}
+
+/**
+ * @return 0 on success; -1 if io_uring_enter failed, in which case files that
+ *  were queued are still open and haven't been handed back */
+static int __run_uring(
+    loader_t * l,
+    uring_t * r
+)
+{
+    int inflight = 0, unsubmitted = 0;
+
+    while (l->next < l->nfiles || 0 < inflight + unsubmitted)
+    {
+        unsigned head;
+        int ret;
+
+        /* fill up the submission queue */
+        while (inflight + unsubmitted < BENCODE_LOADER_QUEUE_DEPTH &&
+               l->next < l->nfiles)
+        {
+            int i = l->next++;
+            bencode_loader_file_t *f = &l->files[i];
+
+            if (-1 == __open(l, f) || 0 == f->len)
+            {
+                __complete(l, f);
+                continue;
+            }
+
+            __uring_queue_read(r, f, i);
+            unsubmitted++;
+        }
+
+        if (0 == inflight + unsubmitted)
+            continue;
+
+        ret = syscall(__NR_io_uring_enter, r->fd, unsubmitted, 1,
+                      IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            if (-1 == __uring_drain(l, r, inflight))
+                __abandon_queued(l);
+            return -1;
+        }
+
+        unsubmitted -= ret;
+        inflight += ret;
+
+        /* reap completions */
+        head = *r->cq_head;
+        while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+        {
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            bencode_loader_file_t *f = &l->files[cqe->user_data];
+
+            head++;
+            inflight--;
+
+            if (cqe->res < 0)
+                f->err = -cqe->res;
+            else if (0 == cqe->res)
+                f->err = EIO;
+            else if ((f->got += cqe->res) < f->len)
+            {
+                /* a short read; ask for the rest */
+                __uring_queue_read(r, f, cqe->user_data);
+                unsubmitted++;
+                continue;
+            }
+
+            __complete(l, f);
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    return 0;
+}
+
+/**
+ * Finish the files that io_uring was in the middle of, with blocking reads
+ * that carry on from the last completion */
+static void __finish_queued(
+    loader_t * l
+)
+{
+    int i;
+
+    for (i = 0; i < l->next; i++)
+    {
+        bencode_loader_file_t *f = &l->files[i];
+
+        /* handed back files have been closed */
+        if (-1 == f->fd)
+            continue;
+
+        if (0 == f->err)
+            __read_rest(f);
+        __complete(l, f);
+    }
+}
+
+#endif /* HAVE_IO_URING */
+
+int bencode_loader_run(
+    bencode_loader_file_t * files,
+    int nfiles,
+    char *arena,
+    size_t arenalen,
+    int nthreads,
+    int flags,
+    bencode_loader_cb cb,
+    void *udata
+)
+{
+    loader_t l;
+
+    memset(&l, 0, sizeof(loader_t));
+    l.files = files;
+    l.nfiles = nfiles;
+    l.arena = arena;
+    l.arenalen = arenalen;
+    l.cb = cb;
+    l.udata = udata;
+
+#ifdef HAVE_IO_URING
+    if (!(flags & BENCODE_LOADER_THREADS))
+    {
+        uring_t r;
+
+        if (0 == __uring_setup(&r))
+        {
+            int ret = __run_uring(&l, &r);
+
+            __uring_teardown(&r);
+            if (0 == ret)
+                return 0;
+
+            /* io_uring gave up on us; the thread pool does the rest */
+            __finish_queued(&l);
+        }
+    }
+#else
+    (void)flags;
+#endif
+
+    return __run_threads(&l, nthreads);
+}
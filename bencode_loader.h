@@ -0,0 +1,80 @@
+#ifndef BENCODE_LOADER_H_
+#define BENCODE_LOADER_H_
+
+#include <stddef.h>
+
+#include "bencode.h"
+
+/* reads kept in flight through io_uring */
+#ifndef BENCODE_LOADER_QUEUE_DEPTH
+#define BENCODE_LOADER_QUEUE_DEPTH 64
+#endif
+
+/* the most that is asked for in one read */
+#ifndef BENCODE_LOADER_MAX_READ
+#define BENCODE_LOADER_MAX_READ 0x7fffffff
+#endif
+
+enum {
+    /** don't use io_uring, even if it is available */
+    BENCODE_LOADER_THREADS = 1 << 0
+};
+
+typedef struct
+{
+    /* file to load */
+    const char *path;
+
+    /* contents of the file, within the arena */
+    char *buf;
+    int len;
+
+    /* 0 on success; EBADMSG if the file isn't valid bencode;
+     * otherwise the errno of the failed I/O */
+    int err;
+
+    /* cursor at the start of the file's contents */
+    bencode_t be;
+
+    /* internal */
+    int fd;
+    int got;
+} bencode_loader_file_t;
+
+/**
+ * Called as each file completes, in the order they complete.
+ * When the thread pool is used this is called from the worker threads.
+ */
+typedef void (*bencode_loader_cb)(
+    bencode_loader_file_t * f,
+    void *udata
+);
+
+/**
+* Load, validate and set up cursors for many small files.
+* Reads are submitted through io_uring where the kernel supports it;
+* otherwise a pool of threads does blocking reads. If io_uring fails part way
+* through, the reads the kernel already has are waited for, then the files
+* it had queued and the rest are loaded by the pool.
+* @param files Files to load; only path needs to be set
+* @param nfiles Number of files
+* @param arena Memory that file contents are read into
+* @param arenalen Length of arena. Files that don't fit fail with ENOSPC
+* @param nthreads Number of threads for the thread pool
+* @param flags BENCODE_LOADER_* flags
+* @param cb Callback for each file as it completes
+* @param udata User data passed to cb
+* @return 0 on success; -1 if the loader couldn't be started
+*/
+int bencode_loader_run(
+    bencode_loader_file_t * files,
+    int nfiles,
+    char *arena,
+    size_t arenalen,
+    int nthreads,
+    int flags,
+    bencode_loader_cb cb,
+    void *udata
+);
+
+#endif /* BENCODE_LOADER_H_ */
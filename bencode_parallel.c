@@ -0,0 +1,177 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Encode chunks of a large value in parallel
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "bencode_parallel.h"
+
+typedef struct
+{
+    bencode_writer_t *chunks;
+    int nchunks;
+    bencode_encode_cb cb;
+    void *udata;
+
+    /* next chunk to hand out */
+    int next;
+} encoder_t;
+
+static void *__worker(
+    void *arg
+)
+{
+    encoder_t *e = arg;
+    int i;
+
+    while ((i = __atomic_fetch_add(&e->next, 1, __ATOMIC_RELAXED)) < e->nchunks)
+        e->cb(e->udata, i, &e->chunks[i]);
+
+    return NULL;
+}
+
+int bencode_write_parallel(
+    bencode_writer_t * chunks,
+    int nchunks,
+    int nthreads,
+    bencode_encode_cb cb,
+    void *udata
+)
+{
+    pthread_t threads[64];
+    encoder_t e;
+    int i, started = 0;
+
+    e.chunks = chunks;
+    e.nchunks = nchunks;
+    e.cb = cb;
+    e.udata = udata;
+    e.next = 0;
+
+    if (nchunks < nthreads)
+        nthreads = nchunks;
+    if (64 < nthreads)
+        nthreads = 64;
+
+    /* the calling thread takes a share too */
+    for (i = 1; i < nthreads; i++)
+    {
+        if (0 != pthread_create(&threads[started], NULL, __worker, &e))
+            break;
+        started++;
+    }
+
+    __worker(&e);
+
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    for (i = 0; i < nchunks; i++)
+        if (chunks[i].cap < chunks[i].len)
+            return -1;
+
+    return 0;
+}
+
+/**
+ * @return total length of the chunks; -1 if one overflowed */
+static long int __chunks_len(
+    const bencode_writer_t * chunks,
+    int nchunks
+)
+{
+    long int len = 0;
+    int i;
+
+    for (i = 0; i < nchunks; i++)
+    {
+        if (chunks[i].cap < chunks[i].len)
+            return -1;
+        len += chunks[i].len;
+    }
+
+    return len;
+}
+
+static int __header(
+    char *hdr,
+    int type,
+    long int len
+)
+{
+    if (BENCODE_CHUNKS_STRING == type)
+        return sprintf(hdr, "%ld:", len);
+    hdr[0] = 'l';
+    return 1;
+}
+
+int bencode_chunks_iovec(
+    const bencode_writer_t * chunks,
+    int nchunks,
+    int type,
+    char *hdr,
+    struct iovec *iov
+)
+{
+    long int len = __chunks_len(chunks, nchunks);
+    int i, n = 0;
+
+    if (-1 == len)
+        return -1;
+
+    iov[n].iov_base = hdr;
+    iov[n++].iov_len = __header(hdr, type, len);
+
+    for (i = 0; i < nchunks; i++)
+    {
+        /* empty chunks would only make writev do more work */
+        if (0 == chunks[i].len)
+            continue;
+        iov[n].iov_base = chunks[i].buf;
+        iov[n++].iov_len = chunks[i].len;
+    }
+
+    if (BENCODE_CHUNKS_LIST == type)
+    {
+        iov[n].iov_base = "e";
+        iov[n++].iov_len = 1;
+    }
+
+    return n;
+}
+
+int bencode_write_chunks(
+    bencode_writer_t * w,
+    const bencode_writer_t * chunks,
+    int nchunks,
+    int type
+)
+{
+    char hdr[BENCODE_CHUNKS_HDR_LEN];
+    long int len = __chunks_len(chunks, nchunks);
+    int i, ret;
+
+    if (-1 == len)
+        return -1;
+
+    ret = bencode_write_raw(w, hdr, __header(hdr, type, len));
+
+    for (i = 0; i < nchunks; i++)
+        if (-1 == bencode_write_raw(w, chunks[i].buf, chunks[i].len))
+            ret = -1;
+
+    if (BENCODE_CHUNKS_LIST == type && -1 == bencode_write_end(w))
+        ret = -1;
+
+    return ret;
+}
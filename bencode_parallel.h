@@ -0,0 +1,84 @@
+#ifndef BENCODE_PARALLEL_H_
+#define BENCODE_PARALLEL_H_
+
+#include <sys/uio.h>
+
+#include "bencode_writer.h"
+
+/** Room needed for the header bencode_chunks_iovec writes */
+#define BENCODE_CHUNKS_HDR_LEN 24
+
+enum {
+    /** the chunks are items of a list: "l" ... "e" */
+    BENCODE_CHUNKS_LIST,
+    /** the chunks are pieces of one string: "<len>:" ... */
+    BENCODE_CHUNKS_STRING
+};
+
+/**
+* Encode one chunk of a value.
+* @param udata User data passed to bencode_write_parallel
+* @param chunk Index of the chunk to encode
+* @param w Writer for this chunk only
+*/
+typedef void (*bencode_encode_cb)(
+    void *udata,
+    int chunk,
+    bencode_writer_t * w
+);
+
+/**
+* Encode independent chunks of a value on several threads.
+* Each chunk is encoded by the callback into its own writer, so the threads
+* never share a buffer. The chunks can then be joined with
+* bencode_chunks_iovec without copying them again.
+* @param chunks Writers already initialised with a buffer each
+* @param nchunks Number of chunks
+* @param nthreads Number of threads to use, at most 64
+* @param cb Callback that encodes a chunk
+* @param udata User data passed to the callback
+* @return 0 on success; -1 if a chunk did not fit, in which case the len of
+*  its writer is the size it needs
+*/
+int bencode_write_parallel(
+    bencode_writer_t * chunks,
+    int nchunks,
+    int nthreads,
+    bencode_encode_cb cb,
+    void *udata
+);
+
+/**
+* Point iovecs at encoded chunks, surrounded by what makes them one value.
+* For a string the length prefix is worked out from the chunk sizes.
+* @param chunks The encoded chunks
+* @param nchunks Number of chunks
+* @param type BENCODE_CHUNKS_LIST or BENCODE_CHUNKS_STRING
+* @param hdr Buffer of BENCODE_CHUNKS_HDR_LEN bytes for the header
+* @param iov Iovecs we are writing to; needs room for nchunks + 2
+* @return number of iovecs used, ready for writev; -1 if a chunk overflowed
+*/
+int bencode_chunks_iovec(
+    const bencode_writer_t * chunks,
+    int nchunks,
+    int type,
+    char *hdr,
+    struct iovec *iov
+);
+
+/**
+* Join encoded chunks into a writer, for when one buffer is needed.
+* @param w Writer the value goes to
+* @param chunks The encoded chunks
+* @param nchunks Number of chunks
+* @param type BENCODE_CHUNKS_LIST or BENCODE_CHUNKS_STRING
+* @return 0 on success; -1 if the buffer is full or a chunk overflowed
+*/
+int bencode_write_chunks(
+    bencode_writer_t * w,
+    const bencode_writer_t * chunks,
+    int nchunks,
+    int type
+);
+
+#endif /* BENCODE_PARALLEL_H_ */
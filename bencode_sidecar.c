@@ -0,0 +1,262 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Persist a structural index next to the file it indexes
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bencode_sidecar.h"
+
+#define SIDECAR_MAGIC "BENCIDX1"
+#define SIDECAR_VERSION 3
+
+/* the hash reads this many blocks spread evenly over the file */
+#define HASH_BLOCKS 64
+#define HASH_BLOCK_LEN 4096
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t sample;
+    uint64_t size;
+    uint64_t mtime;
+    uint64_t mtime_nsec;
+    uint64_t hash;
+    int64_t len;
+    int64_t nvalues;
+    uint64_t memlen;
+
+    /* checksum of the index that follows */
+    uint64_t checksum;
+} header_t;
+
+/**
+ * Hash of the file's contents.
+ * Hashing every byte of a multi-GB file would cost as much as rebuilding the
+ * index, so only evenly spaced blocks (including the first and last) are
+ * read. The size and mtime catch the rest. */
+static uint64_t __hash(
+    const char *buf,
+    long int len
+)
+{
+    uint64_t h = 14695981039346656037ULL;
+    long int b;
+
+    for (b = 0; b < HASH_BLOCKS; b++)
+    {
+        long int start = 0, i, end;
+
+        if (HASH_BLOCK_LEN < len)
+            start = (len - HASH_BLOCK_LEN) / (HASH_BLOCKS - 1) * b;
+        end = start + HASH_BLOCK_LEN < len ? start + HASH_BLOCK_LEN : len;
+
+        for (i = start; i < end; i++)
+        {
+            h ^= (unsigned char)buf[i];
+            h *= 1099511628211ULL;
+        }
+
+        if (len <= HASH_BLOCK_LEN)
+            break;
+    }
+
+    return h;
+}
+
+/**
+ * Checksum of the saved index.
+ * The sindex lookups trust the index, so unlike the source file every byte
+ * is covered; the index is only a few bits per value, so this is cheap. */
+static uint64_t __checksum(
+    const void *mem,
+    size_t len
+)
+{
+    const char *p = mem;
+    uint64_t h = 14695981039346656037ULL ^ len, w;
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8)
+    {
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+    }
+
+    for (; i < len; i++)
+    {
+        h ^= (unsigned char)p[i];
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+/**
+ * @param len Length of buf; -1 if buf is known to hold the whole file */
+static int __make_header(
+    header_t * h,
+    int srcfd,
+    const char *buf,
+    long int len
+)
+{
+    struct stat st;
+
+    if (-1 == fstat(srcfd, &st))
+        return -1;
+
+    if (-1 != len && len < st.st_size)
+        return -1;
+
+    memset(h, 0, sizeof(header_t));
+    memcpy(h->magic, SIDECAR_MAGIC, sizeof(h->magic));
+    h->version = SIDECAR_VERSION;
+    h->sample = BENCODE_SINDEX_SAMPLE;
+    h->size = st.st_size;
+    h->mtime = st.st_mtime;
+    /* a rewrite within the same second would otherwise look fresh */
+#ifdef __APPLE__
+    h->mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+    h->mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+    h->hash = __hash(buf, st.st_size);
+    return 0;
+}
+
+static int __write_all(
+    int fd,
+    const void *buf,
+    size_t len
+)
+{
+    const char *p = buf;
+
+    while (0 < len)
+    {
+        ssize_t n = write(fd, p, len);
+
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+int bencode_sidecar_save(
+    const bencode_sindex_t * idx,
+    const char *path,
+    int srcfd
+)
+{
+    char tmp[4096];
+    header_t h;
+    int fd;
+
+    if (-1 == __make_header(&h, srcfd, idx->buf, -1))
+        return -1;
+
+    h.len = idx->len;
+    h.nvalues = idx->nvalues;
+    h.memlen = idx->memlen;
+    h.checksum = __checksum(idx->mem, idx->memlen);
+
+    if ((int)sizeof(tmp) <= snprintf(tmp, sizeof(tmp), "%s.tmp", path))
+        return -1;
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (-1 == fd)
+        return -1;
+
+    if (-1 == __write_all(fd, &h, sizeof(h)) ||
+        -1 == __write_all(fd, idx->mem, idx->memlen) ||
+        -1 == fsync(fd))
+    {
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+
+    close(fd);
+    return rename(tmp, path);
+}
+
+int bencode_sidecar_load(
+    bencode_sindex_t * idx,
+    const char *path,
+    int srcfd,
+    const char *buf,
+    long int len
+)
+{
+    const header_t *h;
+    header_t expected;
+    struct stat st;
+    void *map;
+    int fd;
+
+    if (-1 == __make_header(&expected, srcfd, buf, len))
+        return -1;
+
+    fd = open(path, O_RDONLY);
+    if (-1 == fd)
+        return -1;
+
+    if (-1 == fstat(fd, &st) || st.st_size < (off_t)sizeof(header_t))
+    {
+        close(fd);
+        return -1;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == map)
+        return -1;
+
+    h = map;
+    if (memcmp(h->magic, expected.magic, sizeof(h->magic)) ||
+        h->version != expected.version ||
+        h->sample != expected.sample ||
+        h->size != expected.size ||
+        h->mtime != expected.mtime ||
+        h->mtime_nsec != expected.mtime_nsec ||
+        h->hash != expected.hash ||
+        /* every value takes up at least a byte of the source */
+        h->len < 1 || h->len > len || (uint64_t)h->len > h->size ||
+        h->nvalues < 1 || h->nvalues > h->len ||
+        h->memlen != st.st_size - sizeof(header_t) ||
+        h->checksum != __checksum((char *)map + sizeof(header_t), h->memlen) ||
+        -1 == bencode_sindex_attach(idx, (char *)map + sizeof(header_t),
+                                    h->memlen, buf, h->len, h->nvalues))
+    {
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    return 0;
+}
+
+void bencode_sidecar_unload(
+    bencode_sindex_t * idx
+)
+{
+    munmap((char *)idx->mem - sizeof(header_t),
+           idx->memlen + sizeof(header_t));
+}
@@ -0,0 +1,49 @@
+#ifndef BENCODE_SIDECAR_H_
+#define BENCODE_SIDECAR_H_
+
+#include "bencode_sindex.h"
+
+/**
+* Write a built index to a sidecar file.
+* The sidecar is keyed by the source file's size, mtime (to the nanosecond)
+* and a hash of its contents, so a stale sidecar is never used. The index
+* itself is checksummed, so a corrupt sidecar is never used either. The file
+* is written to a temporary name and renamed into place.
+* @param idx The index, built over the whole contents of the source file
+* @param path Path of the sidecar file
+* @param srcfd File descriptor of the file the index was built over
+* @return 0 on success; otherwise -1
+*/
+int bencode_sidecar_save(
+    const bencode_sindex_t * idx,
+    const char *path,
+    int srcfd
+);
+
+/**
+* Map a sidecar file back into memory.
+* Lookups can start immediately; nothing is rebuilt.
+* @param idx The index we are setting up
+* @param path Path of the sidecar file
+* @param srcfd File descriptor of the source file
+* @param buf Contents of the source file (eg. mmapped)
+* @param len Length of buf
+* @return 0 on success; -1 if the sidecar is missing, invalid or stale
+*/
+int bencode_sidecar_load(
+    bencode_sindex_t * idx,
+    const char *path,
+    int srcfd,
+    const char *buf,
+    long int len
+);
+
+/**
+* Unmap an index that was set up by bencode_sidecar_load.
+* @param idx The index
+*/
+void bencode_sidecar_unload(
+    bencode_sindex_t * idx
+);
+
+#endif /* BENCODE_SIDECAR_H_ */
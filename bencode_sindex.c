@@ -0,0 +1,661 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Succinct structural index over bencoded data
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "bencode_sindex.h"
+
+#define SB_BITS 512
+#define SB_WORDS (SB_BITS / 64)
+
+static long int __nsb(
+    long int nvalues
+)
+{
+    long int nbits = nvalues * 2;
+
+    return 0 == nbits ? 1 : (nbits + SB_BITS - 1) / SB_BITS;
+}
+
+/**
+ * @return number of leaves in the min-excess tree; a power of two */
+static long int __tsize(
+    long int nvalues
+)
+{
+    long int nsb = __nsb(nvalues), size = 1;
+
+    while (size < nsb)
+        size *= 2;
+    return size;
+}
+
+static long int __nsamples(
+    long int nvalues
+)
+{
+    return (nvalues + BENCODE_SINDEX_SAMPLE - 1) / BENCODE_SINDEX_SAMPLE;
+}
+
+static size_t __mem_size(
+    long int nvalues
+)
+{
+    long int nsb = __nsb(nvalues);
+    size_t size;
+
+    size = nsb * SB_WORDS * sizeof(uint64_t);
+    size += (nsb + 1) * sizeof(uint64_t);
+    size += __nsamples(nvalues) * sizeof(uint64_t);
+    size += __tsize(nvalues) * sizeof(int64_t);
+    size += nsb * sizeof(int16_t);
+    size += nsb * SB_WORDS * sizeof(int8_t);
+    return size;
+}
+
+static void __emit(
+    bencode_sindex_t * idx,
+    int open
+)
+{
+    if (open)
+        idx->bits[idx->nbits >> 6] |= (uint64_t)1 << (idx->nbits & 63);
+    idx->nbits++;
+}
+
+/**
+ * Read the length of a string and skip over it
+ * @return position after the string; otherwise -1 */
+static long int __skip_string(
+    const char *buf,
+    long int len,
+    long int pos
+)
+{
+    long int slen = 0;
+
+    if (!isdigit(buf[pos]))
+        return -1;
+
+    while (pos < len && isdigit(buf[pos]))
+    {
+        if (slen > len)
+            return -1;
+        slen = slen * 10 + buf[pos++] - '0';
+    }
+
+    if (pos == len || buf[pos] != ':' || len - pos - 1 < slen)
+        return -1;
+
+    return pos + 1 + slen;
+}
+
+/**
+ * @return position after the int; otherwise -1 */
+static long int __skip_int(
+    const char *buf,
+    long int len,
+    long int pos
+)
+{
+    /* move off the 'i' */
+    pos++;
+
+    if (pos < len && buf[pos] == '-')
+        pos++;
+
+    if (pos == len || !isdigit(buf[pos]))
+        return -1;
+
+    while (pos < len && isdigit(buf[pos]))
+        pos++;
+
+    if (pos == len || buf[pos] != 'e')
+        return -1;
+
+    return pos + 1;
+}
+
+/**
+ * Walk over every value in preorder
+ * @param idx Index to fill in; NULL if we are only counting
+ * @param end Position after the first complete value
+ * @return number of values; otherwise -1 */
+static long int __scan(
+    const char *buf,
+    long int len,
+    bencode_sindex_t * idx,
+    long int *end
+)
+{
+    long int pos = 0, nvalues = 0, depth = 0;
+
+    while (pos < len)
+    {
+        const char c = buf[pos];
+
+        if (c == 'e')
+        {
+            if (0 == depth)
+                return -1;
+            depth--;
+            pos++;
+            if (idx)
+                __emit(idx, 0);
+        }
+        else
+        {
+            if (idx && 0 == nvalues % BENCODE_SINDEX_SAMPLE)
+                idx->samples[nvalues / BENCODE_SINDEX_SAMPLE] = pos;
+            nvalues++;
+            if (idx)
+                __emit(idx, 1);
+
+            if (c == 'd' || c == 'l')
+            {
+                depth++;
+                pos++;
+                continue;
+            }
+            else if (c == 'i')
+                pos = __skip_int(buf, len, pos);
+            else
+                pos = __skip_string(buf, len, pos);
+
+            if (-1 == pos)
+                return -1;
+            if (idx)
+                __emit(idx, 0);
+        }
+
+        if (0 == depth)
+        {
+            *end = pos;
+            return nvalues;
+        }
+    }
+
+    /* ran out of input */
+    return -1;
+}
+
+size_t bencode_sindex_size(
+    const char *buf,
+    long int len
+)
+{
+    long int nvalues, end;
+
+    nvalues = __scan(buf, len, NULL, &end);
+    if (-1 == nvalues)
+        return 0;
+    return __mem_size(nvalues);
+}
+
+/* a leaf past the last superblock, which can't hold a close */
+#define NO_CLOSE (INT64_MAX / 2)
+
+/**
+ * @return excess over the superblocks under this node of the tree */
+static long int __node_excess(
+    const bencode_sindex_t * idx,
+    long int v
+)
+{
+    long int nsb = __nsb(idx->nvalues), lo = v, n = 1, hi;
+
+    while (lo < idx->tsize)
+    {
+        lo *= 2;
+        n *= 2;
+    }
+    lo -= idx->tsize;
+
+    if (nsb <= lo)
+        return 0;
+    hi = lo + n < nsb ? lo + n : nsb;
+    return 2 * (long int)(idx->rank[hi] - idx->rank[lo]) - (hi - lo) * SB_BITS;
+}
+
+/**
+ * @return minimum excess within this node of the tree */
+static int64_t __node_min(
+    const bencode_sindex_t * idx,
+    long int v
+)
+{
+    if (v < idx->tsize)
+        return idx->tmin[v];
+    if (v - idx->tsize < __nsb(idx->nvalues))
+        return idx->sbmin[v - idx->tsize];
+    return NO_CLOSE;
+}
+
+/**
+ * Fill in the min-excess tree, from the leaves up */
+static void __build_tree(
+    bencode_sindex_t * idx
+)
+{
+    long int v;
+
+    for (v = idx->tsize - 1; 0 < v; v--)
+    {
+        int64_t l = __node_min(idx, 2 * v), r = __node_min(idx, 2 * v + 1);
+
+        if (r != NO_CLOSE)
+            r += __node_excess(idx, 2 * v);
+        idx->tmin[v] = l < r ? l : r;
+    }
+}
+
+/**
+ * Fill in the rank and min-excess directories */
+static void __build_directories(
+    bencode_sindex_t * idx
+)
+{
+    long int nsb = __nsb(idx->nvalues), s, w;
+    uint64_t ones = 0;
+
+    for (s = 0; s < nsb; s++)
+    {
+        int excess = 0, sbmin = SB_BITS;
+
+        idx->rank[s] = ones;
+
+        for (w = s * SB_WORDS; w < (s + 1) * SB_WORDS; w++)
+        {
+            uint64_t word = idx->bits[w];
+            int b, e = 0, wmin = 64;
+
+            for (b = 0; b < 64; b++)
+            {
+                e += (word >> b) & 1 ? 1 : -1;
+                if (e < wmin)
+                    wmin = e;
+            }
+
+            idx->wmin[w] = wmin;
+            if (excess + wmin < sbmin)
+                sbmin = excess + wmin;
+            excess += e;
+            ones += __builtin_popcountll(word);
+        }
+
+        idx->sbmin[s] = sbmin;
+    }
+
+    idx->rank[nsb] = ones;
+}
+
+/**
+ * Point the index's tables into the caller's memory */
+static void __layout(
+    bencode_sindex_t * idx,
+    void *mem,
+    size_t memlen,
+    const char *buf,
+    long int len,
+    long int nvalues
+)
+{
+    long int nsb = __nsb(nvalues);
+    char *p = mem;
+
+    memset(idx, 0, sizeof(bencode_sindex_t));
+
+    idx->bits = (uint64_t *)p;
+    p += nsb * SB_WORDS * sizeof(uint64_t);
+    idx->rank = (uint64_t *)p;
+    p += (nsb + 1) * sizeof(uint64_t);
+    idx->samples = (uint64_t *)p;
+    p += __nsamples(nvalues) * sizeof(uint64_t);
+    idx->tmin = (int64_t *)p;
+    idx->tsize = __tsize(nvalues);
+    p += idx->tsize * sizeof(int64_t);
+    idx->sbmin = (int16_t *)p;
+    p += nsb * sizeof(int16_t);
+    idx->wmin = (int8_t *)p;
+
+    idx->buf = buf;
+    idx->len = len;
+    idx->nvalues = nvalues;
+    idx->mem = mem;
+    idx->memlen = memlen;
+}
+
+int bencode_sindex_build(
+    bencode_sindex_t * idx,
+    void *mem,
+    size_t memlen,
+    const char *buf,
+    long int len
+)
+{
+    long int nvalues, end;
+
+    nvalues = __scan(buf, len, NULL, &end);
+    if (-1 == nvalues || memlen < __mem_size(nvalues))
+        return -1;
+
+    memset(mem, 0, memlen);
+    __layout(idx, mem, memlen, buf, end, nvalues);
+    /* only what's in use needs to be saved or copied */
+    idx->memlen = __mem_size(nvalues);
+    __scan(buf, len, idx, &end);
+    __build_directories(idx);
+    __build_tree(idx);
+    return 0;
+}
+
+int bencode_sindex_attach(
+    bencode_sindex_t * idx,
+    void *mem,
+    size_t memlen,
+    const char *buf,
+    long int len,
+    long int nvalues
+)
+{
+    if (memlen < __mem_size(nvalues))
+        return -1;
+
+    __layout(idx, mem, memlen, buf, len, nvalues);
+    idx->nbits = nvalues * 2;
+    return 0;
+}
+
+static int __bit(
+    const bencode_sindex_t * idx,
+    long int pos
+)
+{
+    return (idx->bits[pos >> 6] >> (pos & 63)) & 1;
+}
+
+/**
+ * @return number of opens before this position */
+static long int __rank(
+    const bencode_sindex_t * idx,
+    long int pos
+)
+{
+    long int w, r = idx->rank[pos / SB_BITS];
+
+    for (w = pos / SB_BITS * SB_WORDS; w < pos >> 6; w++)
+        r += __builtin_popcountll(idx->bits[w]);
+
+    if (pos & 63)
+        r += __builtin_popcountll(idx->bits[w] &
+                                  (((uint64_t)1 << (pos & 63)) - 1));
+    return r;
+}
+
+/**
+ * @return position of the open of the nth value */
+static long int __select(
+    const bencode_sindex_t * idx,
+    long int n
+)
+{
+    long int lo = 0, hi = __nsb(idx->nvalues) - 1, w;
+    uint64_t word;
+
+    /* find the superblock */
+    while (lo < hi)
+    {
+        long int mid = lo + (hi - lo + 1) / 2;
+
+        if ((long int)idx->rank[mid] <= n)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    n -= idx->rank[lo];
+
+    /* find the word */
+    for (w = lo * SB_WORDS;; w++)
+    {
+        int ones = __builtin_popcountll(idx->bits[w]);
+
+        if (n < ones)
+            break;
+        n -= ones;
+    }
+
+    /* find the bit */
+    word = idx->bits[w];
+    while (0 < n--)
+        word &= word - 1;
+
+    return w * 64 + __builtin_ctzll(word);
+}
+
+/**
+ * Find the first superblock, from this one on, that the excess drops to -1
+ * in. The tree is climbed until a node to the right holds the drop, then
+ * descended to it.
+ * @param d Excess at the start of the superblock; updated to the excess at
+ *  the start of the one found
+ * @return the superblock; otherwise -1 */
+static long int __find_superblock(
+    const bencode_sindex_t * idx,
+    long int s,
+    long int *d
+)
+{
+    long int v = idx->tsize + s, e = *d;
+
+    while (-1 < e + __node_min(idx, v))
+    {
+        e += __node_excess(idx, v);
+
+        /* climb while we are the right child, then move over to the right */
+        while (v & 1)
+        {
+            if (1 == v)
+                return -1;
+            v /= 2;
+        }
+        v++;
+    }
+
+    while (v < idx->tsize)
+    {
+        v *= 2;
+        if (-1 < e + __node_min(idx, v))
+        {
+            e += __node_excess(idx, v);
+            v++;
+        }
+    }
+
+    *d = e;
+    return v - idx->tsize;
+}
+
+/**
+ * @return position of the close that matches this open; otherwise -1 */
+static long int __find_close(
+    const bencode_sindex_t * idx,
+    long int pos
+)
+{
+    long int q = pos + 1, d = 0;
+
+    while (q < idx->nbits)
+    {
+        long int w = q >> 6;
+
+        /* jump to the superblock the close is in */
+        if (0 == q % SB_BITS && -1 < d + idx->sbmin[q / SB_BITS])
+        {
+            long int s = __find_superblock(idx, q / SB_BITS, &d);
+
+            if (-1 == s)
+                return -1;
+            q = s * SB_BITS;
+            continue;
+        }
+
+        /* jump over whole words */
+        if (0 == (q & 63) && -1 < d + idx->wmin[w])
+        {
+            d += 2 * __builtin_popcountll(idx->bits[w]) - 64;
+            q += 64;
+            continue;
+        }
+
+        d += __bit(idx, q) ? 1 : -1;
+        if (-1 == d)
+            return q;
+        q++;
+    }
+
+    return -1;
+}
+
+/**
+ * Move from the start of one value to the start of the next value in
+ * preorder. The input has already been checked by the scan. */
+static long int __next_value(
+    const bencode_sindex_t * idx,
+    long int pos
+)
+{
+    const char c = idx->buf[pos];
+
+    if (c == 'd' || c == 'l')
+        pos++;
+    else if (c == 'i')
+        pos = __skip_int(idx->buf, idx->len, pos);
+    else
+        pos = __skip_string(idx->buf, idx->len, pos);
+
+    while (pos < idx->len && idx->buf[pos] == 'e')
+        pos++;
+
+    return pos;
+}
+
+/**
+ * @return byte offset of the nth value */
+static long int __offset(
+    const bencode_sindex_t * idx,
+    long int n
+)
+{
+    long int i = n / BENCODE_SINDEX_SAMPLE * BENCODE_SINDEX_SAMPLE;
+    long int pos = idx->samples[n / BENCODE_SINDEX_SAMPLE];
+
+    for (; i < n; i++)
+        pos = __next_value(idx, pos);
+    return pos;
+}
+
+/**
+ * @return the value number that starts at this byte offset; otherwise -1 */
+static long int __ordinal(
+    const bencode_sindex_t * idx,
+    long int offset
+)
+{
+    long int lo = 0, hi = __nsamples(idx->nvalues) - 1, n, pos;
+
+    if (offset < 0 || idx->len <= offset)
+        return -1;
+
+    while (lo < hi)
+    {
+        long int mid = lo + (hi - lo + 1) / 2;
+
+        if ((long int)idx->samples[mid] <= offset)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    n = lo * BENCODE_SINDEX_SAMPLE;
+    pos = idx->samples[lo];
+    while (pos < offset && n < idx->nvalues - 1)
+    {
+        pos = __next_value(idx, pos);
+        n++;
+    }
+
+    return pos == offset ? n : -1;
+}
+
+const char *bencode_sindex_value_end(
+    const bencode_sindex_t * idx,
+    const char *value
+)
+{
+    long int n, open, close, next;
+
+    n = __ordinal(idx, value - idx->buf);
+    if (-1 == n)
+        return NULL;
+
+    /* leaves are cheaper to skip by hand */
+    if (*value == 'i')
+        return idx->buf + __skip_int(idx->buf, idx->len, value - idx->buf);
+    else if (isdigit(*value))
+        return idx->buf + __skip_string(idx->buf, idx->len, value - idx->buf);
+
+    open = __select(idx, n);
+    close = __find_close(idx, open);
+    assert(-1 != close);
+
+    /* Only containers can close between two values, and each of those
+     * closes is a single 'e' */
+    next = __rank(idx, close);
+    if (next == idx->nvalues)
+        return idx->buf + idx->len - (idx->nbits - close - 1);
+
+    return idx->buf + __offset(idx, next) -
+        (__select(idx, next) - close - 1);
+}
+
+const char *bencode_sindex_child(
+    const bencode_sindex_t * idx,
+    const char *container,
+    long int n
+)
+{
+    long int ord, pos;
+
+    if (*container != 'd' && *container != 'l')
+        return NULL;
+
+    ord = __ordinal(idx, container - idx->buf);
+    if (-1 == ord)
+        return NULL;
+
+    pos = __select(idx, ord) + 1;
+
+    for (; 0 <= n; n--)
+    {
+        /* no more children */
+        if (!__bit(idx, pos))
+            return NULL;
+        if (0 == n)
+            break;
+        pos = __find_close(idx, pos) + 1;
+    }
+
+    return idx->buf + __offset(idx, __rank(idx, pos));
+}
@@ -0,0 +1,135 @@
+#ifndef BENCODE_SINDEX_H_
+#define BENCODE_SINDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* byte offsets are kept for every Nth value */
+#ifndef BENCODE_SINDEX_SAMPLE
+#define BENCODE_SINDEX_SAMPLE 128
+#endif
+
+/**
+ * Succinct structural index over a bencoded buffer.
+ *
+ * Every value (dict keys included) is a pair of balanced parentheses in
+ * preorder, so the structure costs 2 bits per value. Rank/select and
+ * min-excess directories, with a min-excess tree over the 512 bit
+ * superblocks, find the end of a value in O(log n) steps, and a sampled
+ * offset table maps values back to the buffer. In total this is roughly
+ * 3.5 bits per value.
+ *
+ * The index lives entirely in memory handed over by the caller.
+ */
+typedef struct
+{
+    const char *buf;
+
+    /* length of the indexed value */
+    long int len;
+
+    long int nvalues;
+
+    /* length of the parentheses sequence */
+    long int nbits;
+
+    /* parentheses; 1 opens a value, 0 closes it */
+    uint64_t *bits;
+
+    /* number of opens before each 512 bit superblock */
+    uint64_t *rank;
+
+    /* byte offset of every BENCODE_SINDEX_SAMPLE'th value */
+    uint64_t *samples;
+
+    /* minimum excess within each superblock */
+    int16_t *sbmin;
+
+    /* minimum excess within each word */
+    int8_t *wmin;
+
+    /* min-excess tree over the superblocks; node v has children 2v and
+     * 2v + 1, and the superblocks are the leaves, from tsize onwards */
+    int64_t *tmin;
+    long int tsize;
+
+    void *mem;
+    size_t memlen;
+} bencode_sindex_t;
+
+/**
+* Work out how much memory an index over this buffer will need.
+* @param buf Buffer holding a single bencoded value
+* @param len Length of buffer
+* @return number of bytes needed; 0 if the buffer is invalid
+*/
+size_t bencode_sindex_size(
+    const char *buf,
+    long int len
+);
+
+/**
+* Build an index.
+* Only the structure is checked; untrusted input should be validated first.
+* @param idx The index
+* @param mem Memory for the index, aligned for uint64_t
+* @param memlen Length of mem, as given by bencode_sindex_size
+* @param buf Buffer holding a single bencoded value
+* @param len Length of buffer
+* @return 0 on success; otherwise -1
+*/
+int bencode_sindex_build(
+    bencode_sindex_t * idx,
+    void *mem,
+    size_t memlen,
+    const char *buf,
+    long int len
+);
+
+/**
+* Use an index that was built earlier, eg. one read back from disk.
+* The memory is only read from.
+* @param idx The index
+* @param mem Memory holding a built index, aligned for uint64_t
+* @param memlen Length of mem
+* @param buf Buffer the index was built over
+* @param len Length of the indexed value (ie. idx->len when built)
+* @param nvalues Number of values (ie. idx->nvalues when built)
+* @return 0 on success; otherwise -1
+*/
+int bencode_sindex_attach(
+    bencode_sindex_t * idx,
+    void *mem,
+    size_t memlen,
+    const char *buf,
+    long int len,
+    long int nvalues
+);
+
+/**
+* Find the end of a value, skipping all of its children.
+* @param idx The index
+* @param value Start of a value within the indexed buffer
+* @return pointer to one past the end of the value; NULL if value does not
+*  point to the start of a value
+*/
+const char *bencode_sindex_value_end(
+    const bencode_sindex_t * idx,
+    const char *value
+);
+
+/**
+* Get the nth child of a list or dict.
+* Dict keys count as children, so the value of the nth key is child 2n+1.
+* @param idx The index
+* @param container Start of a list or dict within the indexed buffer
+* @param n Position of the child, starting at 0
+* @return pointer to the start of the child; NULL if there is no such child
+*/
+const char *bencode_sindex_child(
+    const bencode_sindex_t * idx,
+    const char *container,
+    long int n
+);
+
+#endif /* BENCODE_SINDEX_H_ */
@@ -0,0 +1,306 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Read bencoded data as it arrives, without buffering it
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "bencode_stream.h"
+
+enum {
+    S_VALUE,
+    S_INT_START,
+    S_INT_FIRST,
+    S_INT_DIGITS,
+    S_STR_LEN,
+    S_STR_BODY,
+    S_DONE,
+    S_ERROR
+};
+
+void bencode_stream_init(
+    bencode_stream_t * s
+)
+{
+    memset(s, 0, sizeof(bencode_stream_t));
+    s->state = S_VALUE;
+}
+
+/**
+ * A value has been completely read; work out what we expect next */
+static void __value_end(
+    bencode_stream_t * s
+)
+{
+    if (0 == s->depth)
+    {
+        s->state = S_DONE;
+        return;
+    }
+
+    if (s->stack[s->depth - 1] == 'k')
+        s->stack[s->depth - 1] = 'v';
+    else if (s->stack[s->depth - 1] == 'v')
+        s->stack[s->depth - 1] = 'k';
+
+    s->state = S_VALUE;
+}
+
+/**
+ * @return 0 on success; otherwise -1 */
+static int __read_value_start(
+    bencode_stream_t * s,
+    const char c
+)
+{
+    char top = 0 < s->depth ? s->stack[s->depth - 1] : 0;
+
+    if (isdigit(c))
+    {
+        s->slen = c - '0';
+        s->state = S_STR_LEN;
+        return 0;
+    }
+
+    /* dict keys have to be strings */
+    if (top == 'k' && c != 'e')
+        return -1;
+
+    switch (c)
+    {
+    case 'e':
+        /* a dict key is missing its value */
+        if (0 == s->depth || top == 'v')
+            return -1;
+        s->depth--;
+        __value_end(s);
+        return 0;
+    case 'i':
+        s->state = S_INT_START;
+        return 0;
+    case 'l':
+    case 'd':
+        if (BENCODE_STREAM_MAX_DEPTH == s->depth)
+            return -1;
+        s->stack[s->depth++] = c == 'l' ? 'l' : 'k';
+        return 0;
+    }
+
+    return -1;
+}
+
+int bencode_stream_feed(
+    bencode_stream_t * s,
+    const char *buf,
+    int len,
+    int *used
+)
+{
+    int i = 0;
+
+    while (i < len && s->state != S_DONE && s->state != S_ERROR)
+    {
+        const char c = buf[i];
+
+        switch (s->state)
+        {
+        case S_VALUE:
+            if (-1 == __read_value_start(s, c))
+                s->state = S_ERROR;
+            break;
+        case S_INT_START:
+            s->ineg = c == '-';
+            s->ival = 0;
+            if (s->ineg)
+                s->state = S_INT_FIRST;
+            else if (isdigit(c))
+            {
+                s->ival = c - '0';
+                s->state = S_INT_DIGITS;
+            }
+            else
+                s->state = S_ERROR;
+            break;
+        case S_INT_FIRST:
+            s->ival = c - '0';
+            s->state = isdigit(c) ? S_INT_DIGITS : S_ERROR;
+            break;
+        case S_INT_DIGITS:
+            if (c == 'e')
+                __value_end(s);
+            /* the same range bencode_int_value accepts */
+            else if (!isdigit(c) ||
+                     ((unsigned long int)LONG_MAX + s->ineg - (c - '0')) / 10
+                     < s->ival)
+                s->state = S_ERROR;
+            else
+                s->ival = s->ival * 10 + c - '0';
+            break;
+        case S_STR_LEN:
+            if (isdigit(c))
+            {
+                if (s->slen > (INT_MAX - 9) / 10)
+                {
+                    s->state = S_ERROR;
+                    break;
+                }
+                s->slen = s->slen * 10 + c - '0';
+            }
+            else if (c == ':')
+            {
+                if (0 == s->slen)
+                    __value_end(s);
+                else
+                    s->state = S_STR_BODY;
+            }
+            else
+                s->state = S_ERROR;
+            break;
+        case S_STR_BODY:
+            {
+                /* skip as much of the string as we have in one go */
+                long int n = len - i < s->slen ? len - i : s->slen;
+
+                s->slen -= n;
+                i += n;
+                if (0 == s->slen)
+                    __value_end(s);
+            }
+            continue;
+        }
+
+        if (s->state != S_ERROR)
+            i++;
+    }
+
+    *used = i;
+    s->consumed += i;
+
+    if (s->state == S_ERROR)
+        return BENCODE_STREAM_ERROR;
+    else if (s->state == S_DONE)
+        return BENCODE_STREAM_DONE;
+    return BENCODE_STREAM_NEED_MORE;
+}
+
+#define LINE 64
+
+typedef struct
+{
+    bencode_stream_t s;
+    const char *p;
+    int left;
+    int msg;
+} lane_t;
+
+/**
+ * Give a lane its next message
+ * @return 0 if there are no more messages; otherwise 1 */
+static int __lane_start(
+    lane_t * l,
+    const char *const *bufs,
+    const int *lens,
+    int *next,
+    int n
+)
+{
+    int i;
+
+    if (*next == n)
+        return 0;
+
+    l->msg = (*next)++;
+    l->p = bufs[l->msg];
+    l->left = lens[l->msg];
+    bencode_stream_init(&l->s);
+    for (i = 0; i < l->left && i < BENCODE_STREAM_BATCH_PREFETCH; i += LINE)
+        __builtin_prefetch(l->p + i);
+    return 1;
+}
+
+/**
+ * Parse up to the end of the lane's current cache line
+ * @param result Set to 0 if the message is valid; otherwise -1
+ * @return 1 while the message is still being read; otherwise 0 */
+static int __lane_step(
+    lane_t * l,
+    int *result
+)
+{
+    int used, e, len;
+
+    /* string bodies are skipped without being read */
+    if (l->s.state == S_STR_BODY)
+    {
+        len = l->s.slen < l->left ? l->s.slen : l->left;
+        bencode_stream_feed(&l->s, l->p, len, &used);
+        l->p += used;
+        l->left -= used;
+    }
+
+    len = LINE - ((uintptr_t)l->p & (LINE - 1));
+    if (l->left < len)
+        len = l->left;
+
+    e = bencode_stream_feed(&l->s, l->p, len, &used);
+    l->p += used;
+    l->left -= used;
+
+    if (e != BENCODE_STREAM_NEED_MORE || 0 == l->left)
+    {
+        *result = e == BENCODE_STREAM_DONE && 0 == l->left ? 0 : -1;
+        return 0;
+    }
+
+    __builtin_prefetch(l->s.state == S_STR_BODY && l->s.slen < l->left ?
+                       l->p + l->s.slen : l->p);
+    return 1;
+}
+
+int bencode_stream_validate_batch(
+    const char *const *bufs,
+    const int *lens,
+    int n,
+    int *results
+)
+{
+    lane_t lanes[BENCODE_STREAM_BATCH_WIDTH];
+    int i, nlanes = 0, next = 0, nvalid = 0;
+
+    while (nlanes < BENCODE_STREAM_BATCH_WIDTH &&
+           __lane_start(&lanes[nlanes], bufs, lens, &next, n))
+        nlanes++;
+
+    /* round robin; finished lanes pick up the next message */
+    while (0 < nlanes)
+    {
+        for (i = 0; i < nlanes; i++)
+        {
+            int e;
+
+            if (__lane_step(&lanes[i], &e))
+                continue;
+
+            results[lanes[i].msg] = e;
+            nvalid += 0 == e;
+
+            if (!__lane_start(&lanes[i], bufs, lens, &next, n))
+            {
+                lanes[i] = lanes[--nlanes];
+                i--;
+            }
+        }
+    }
+
+    return nvalid;
+}
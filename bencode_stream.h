@@ -0,0 +1,102 @@
+#ifndef BENCODE_STREAM_H_
+#define BENCODE_STREAM_H_
+
+#ifndef BENCODE_STREAM_MAX_DEPTH
+#define BENCODE_STREAM_MAX_DEPTH 64
+#endif
+
+enum {
+    BENCODE_STREAM_ERROR = -1,
+    BENCODE_STREAM_NEED_MORE = 0,
+    BENCODE_STREAM_DONE = 1
+};
+
+/**
+ * Resumable parse state for one bencoded value arriving in pieces.
+ * The whole state lives inside this struct; no input is buffered.
+ */
+typedef struct
+{
+    /* what we are in the middle of reading */
+    int state;
+
+    /* number of open containers */
+    int depth;
+
+    /* string length being read, or string bytes left to skip */
+    long int slen;
+
+    /* magnitude of the int being read, so it can be range checked */
+    unsigned long int ival;
+
+    /* the int being read is negative */
+    int ineg;
+
+    /* total bytes consumed so far */
+    long int consumed;
+
+    /* 'l' for list; 'k' or 'v' for dict expecting a key or a value */
+    char stack[BENCODE_STREAM_MAX_DEPTH];
+} bencode_stream_t;
+
+/**
+* Initialise a stream parser.
+* @param s The stream parser
+*/
+void bencode_stream_init(
+    bencode_stream_t * s
+);
+
+/**
+* Feed the next piece of input to the parser.
+* Parsing stops at the end of the first complete value, so bytes belonging
+* to the next message are left alone.
+* @param s The stream parser
+* @param buf Bytes that have just arrived
+* @param len Length of buf
+* @param used Number of bytes of buf that were consumed
+* @return BENCODE_STREAM_DONE when a whole value has been read;
+*  BENCODE_STREAM_NEED_MORE if the value is incomplete;
+*  BENCODE_STREAM_ERROR on invalid input
+*/
+int bencode_stream_feed(
+    bencode_stream_t * s,
+    const char *buf,
+    int len,
+    int *used
+);
+
+#ifndef BENCODE_STREAM_BATCH_WIDTH
+#define BENCODE_STREAM_BATCH_WIDTH 8
+#endif
+
+/* bytes prefetched from the start of each message in a batch */
+#ifndef BENCODE_STREAM_BATCH_PREFETCH
+#define BENCODE_STREAM_BATCH_PREFETCH 256
+#endif
+
+/**
+* Validate many independent messages, interleaved in one thread.
+* BENCODE_STREAM_BATCH_WIDTH messages are parsed at once, a cache line at a
+* time in turn, and the next line of each is prefetched while the others are
+* worked on. Whether that is any faster than feeding the messages to the
+* stream parser one after another depends on the machine; bench/bench_batch
+* measures both.
+* This is the stream parser's check, which is stricter than
+* bencode_validate: a message is valid only if it holds exactly one complete
+* value with nothing after it, and every dict key is a string. So an empty
+* message, trailing data, or a dict with a list as a key are all invalid.
+* @param bufs The messages
+* @param lens Length of each message
+* @param n Number of messages
+* @param results Set to 0 for each valid message; otherwise -1
+* @return number of valid messages
+*/
+int bencode_stream_validate_batch(
+    const char *const *bufs,
+    const int *lens,
+    int n,
+    int *results
+);
+
+#endif /* BENCODE_STREAM_H_ */
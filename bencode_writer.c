@@ -0,0 +1,249 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Write bencoded data
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bencode_writer.h"
+#include "bencode_cursor.h"
+
+void bencode_writer_init(
+    bencode_writer_t * w,
+    char *buf,
+    int cap
+)
+{
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+}
+
+int bencode_write_raw(
+    bencode_writer_t * w,
+    const char *str,
+    int len
+)
+{
+    int fits = w->len + len <= w->cap;
+
+    if (fits)
+        memcpy(w->buf + w->len, str, len);
+    w->len += len;
+    return fits ? 0 : -1;
+}
+
+int bencode_write_int(
+    bencode_writer_t * w,
+    long int val
+)
+{
+    char tmp[24];
+
+    return bencode_write_raw(w, tmp, sprintf(tmp, "i%lde", val));
+}
+
+int bencode_write_string(
+    bencode_writer_t * w,
+    const char *str,
+    int len
+)
+{
+    char tmp[16];
+    int ret;
+
+    ret = bencode_write_raw(w, tmp, sprintf(tmp, "%d:", len));
+    if (-1 == bencode_write_raw(w, str, len))
+        ret = -1;
+    return ret;
+}
+
+int bencode_write_list_start(
+    bencode_writer_t * w
+)
+{
+    return bencode_write_raw(w, "l", 1);
+}
+
+int bencode_write_dict_start(
+    bencode_writer_t * w
+)
+{
+    return bencode_write_raw(w, "d", 1);
+}
+
+int bencode_write_end(
+    bencode_writer_t * w
+)
+{
+    return bencode_write_raw(w, "e", 1);
+}
+
+/**
+ * Copy a value over untouched
+ * @param end Where the value ends; NULL if unknown
+ * @return 0 on success; -1 on invalid input */
+static int __write_value(
+    bencode_writer_t * w,
+    bencode_t * be,
+    const char *end
+)
+{
+    if (!end && !(end = bencode_value_end(be)))
+        return -1;
+
+    bencode_write_raw(w, be->str, end - be->str);
+    return 0;
+}
+
+static int __merge(
+    bencode_t * a,
+    const char *aend,
+    bencode_t * b,
+    const char *bend,
+    bencode_writer_t * w,
+    int policy
+);
+
+/**
+ * Move on to the next key, which has to sort after the last one; keys out
+ * of order would otherwise be written twice
+ * @return 0 on success; -1 on invalid input */
+static int __next_key(
+    bencode_cursor_t * c
+)
+{
+    const char *prev = c->key;
+    int plen = c->klen, had = c->has;
+
+    if (-1 == __bencode_cursor_next(c))
+        return -1;
+
+    if (had && c->has && 0 <= __bencode_keycmp(prev, plen, c->key, c->klen))
+        return -1;
+
+    return 0;
+}
+
+/**
+ * A full buffer isn't an error here; the writer keeps counting and the
+ * caller finds out at the end.
+ * @return 0 on success; -1 on invalid input or a conflict we can't settle */
+static int __merge_dicts(
+    bencode_t * a,
+    bencode_t * b,
+    bencode_writer_t * w,
+    int policy
+)
+{
+    bencode_cursor_t ca, cb;
+
+    __bencode_cursor_init(&ca, a);
+    __bencode_cursor_init(&cb, b);
+
+    if (-1 == __next_key(&ca) || -1 == __next_key(&cb))
+        return -1;
+
+    bencode_write_dict_start(w);
+
+    while (ca.has || cb.has)
+    {
+        int cmp;
+
+        if (!cb.has)
+            cmp = -1;
+        else if (!ca.has)
+            cmp = 1;
+        else
+            cmp = __bencode_keycmp(ca.key, ca.klen, cb.key, cb.klen);
+
+        if (cmp < 0)
+        {
+            bencode_write_string(w, ca.key, ca.klen);
+            if (-1 == __write_value(w, &ca.item, __bencode_cursor_end(&ca)) ||
+                -1 == __next_key(&ca))
+                return -1;
+        }
+        else if (0 < cmp)
+        {
+            bencode_write_string(w, cb.key, cb.klen);
+            if (-1 == __write_value(w, &cb.item, __bencode_cursor_end(&cb)) ||
+                -1 == __next_key(&cb))
+                return -1;
+        }
+        else
+        {
+            bencode_write_string(w, ca.key, ca.klen);
+            if (-1 == __merge(&ca.item, __bencode_cursor_end(&ca),
+                              &cb.item, __bencode_cursor_end(&cb), w, policy))
+                return -1;
+            if (-1 == __next_key(&ca) || -1 == __next_key(&cb))
+                return -1;
+        }
+    }
+
+    if (!__bencode_container_end(&ca.container) ||
+        !__bencode_container_end(&cb.container))
+        return -1;
+
+    bencode_write_end(w);
+    return 0;
+}
+
+static int __merge(
+    bencode_t * a,
+    const char *aend,
+    bencode_t * b,
+    const char *bend,
+    bencode_writer_t * w,
+    int policy
+)
+{
+    if (bencode_is_dict(a) && bencode_is_dict(b))
+        return __merge_dicts(a, b, w, policy);
+
+    if (!aend && !(aend = bencode_value_end(a)))
+        return -1;
+    if (!bend && !(bend = bencode_value_end(b)))
+        return -1;
+
+    /* the same value in both isn't a conflict */
+    if (aend - a->str == bend - b->str &&
+        !memcmp(a->str, b->str, aend - a->str))
+        return __write_value(w, a, aend);
+
+    switch (policy)
+    {
+    case BENCODE_MERGE_PREFER_A:
+        return __write_value(w, a, aend);
+    case BENCODE_MERGE_PREFER_B:
+        return __write_value(w, b, bend);
+    }
+
+    return -1;
+}
+
+int bencode_merge(
+    bencode_t * a,
+    bencode_t * b,
+    bencode_writer_t * w,
+    int policy
+)
+{
+    if (-1 == __merge(a, NULL, b, NULL, w, policy))
+        return -1;
+
+    /* the buffer was too small */
+    if (w->cap < w->len)
+        return -1;
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+#ifndef BENCODE_WRITER_H_
+#define BENCODE_WRITER_H_
+
+#include "bencode.h"
+
+/**
+ * Writes bencoded data into a caller supplied buffer.
+ * Once the buffer is full nothing more is written, but len keeps counting,
+ * so it tells the caller how big the buffer needs to be.
+ */
+typedef struct
+{
+    char *buf;
+    int cap;
+    int len;
+} bencode_writer_t;
+
+enum {
+    /** keep the value from the first document */
+    BENCODE_MERGE_PREFER_A,
+    /** keep the value from the second document */
+    BENCODE_MERGE_PREFER_B,
+    /** give up on the merge */
+    BENCODE_MERGE_FAIL
+};
+
+/**
+* Initialise a writer.
+* @param w The writer
+* @param buf Buffer we are writing to
+* @param cap Length of buffer
+*/
+void bencode_writer_init(
+    bencode_writer_t * w,
+    char *buf,
+    int cap
+);
+
+/**
+* @return 0 on success; -1 if the buffer is full
+*/
+int bencode_write_int(
+    bencode_writer_t * w,
+    long int val
+);
+
+/**
+* @return 0 on success; -1 if the buffer is full
+*/
+int bencode_write_string(
+    bencode_writer_t * w,
+    const char *str,
+    int len
+);
+
+/**
+* @return 0 on success; -1 if the buffer is full
+*/
+int bencode_write_list_start(
+    bencode_writer_t * w
+);
+
+/**
+* @return 0 on success; -1 if the buffer is full
+*/
+int bencode_write_dict_start(
+    bencode_writer_t * w
+);
+
+/**
+* End the current list or dict.
+* @return 0 on success; -1 if the buffer is full
+*/
+int bencode_write_end(
+    bencode_writer_t * w
+);
+
+/**
+* Copy bytes that are already bencoded.
+* @return 0 on success; -1 if the buffer is full
+*/
+int bencode_write_raw(
+    bencode_writer_t * w,
+    const char *str,
+    int len
+);
+
+/**
+* Merge two documents in a single streaming pass.
+* Dicts are merged key by key, recursively. Their keys have to be sorted;
+* a dict with keys out of order, or one that isn't terminated, is invalid.
+* Values that are only in one document are copied over as raw bytes. Any
+* other clash (eg. two ints, or a list and a dict) is settled by policy.
+* @param a The first (eg. base) document
+* @param b The second (eg. delta) document
+* @param w Writer the merged document goes to
+* @param policy BENCODE_MERGE_* conflict policy
+* @return 0 on success; -1 on invalid input, a BENCODE_MERGE_FAIL conflict,
+*  or if the buffer is full
+*/
+int bencode_merge(
+    bencode_t * a,
+    bencode_t * b,
+    bencode_writer_t * w,
+    int policy
+);
+
+#endif /* BENCODE_WRITER_H_ */
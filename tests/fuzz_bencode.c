@@ -0,0 +1,145 @@
+/**
+ * Fuzz harness that hunts for inputs that are expensive to parse.
+ *
+ * Every input is validated and then fully walked with the iterators, with
+ * BENCODE_STATS counting the bytes touched. The work per input byte is fed
+ * back to libFuzzer as extra coverage, so inputs reaching a new level of
+ * work are kept in the corpus. Inputs above FUZZ_MAX_RATIO are reported as
+ * crashes.
+ *
+ * With FUZZ_REGRESS this builds a standalone program instead, which runs
+ * each file given on the command line and fails if any of them goes over
+ * FUZZ_MAX_RATIO.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bencode.h"
+
+#ifndef BENCODE_STATS
+#error "the fuzz harness needs BENCODE_STATS"
+#endif
+
+#ifndef FUZZ_MAX_RATIO
+#define FUZZ_MAX_RATIO 64
+#endif
+
+#define NBUCKETS 64
+
+#if defined(__clang__) && !defined(FUZZ_REGRESS)
+/* libFuzzer treats these as extra coverage features */
+__attribute__((section("__libfuzzer_extra_counters")))
+#endif
+static uint8_t buckets[NBUCKETS];
+
+static void __walk(
+    bencode_t * be
+)
+{
+    bencode_t item;
+    const char *key;
+    int klen;
+
+    if (bencode_is_dict(be))
+    {
+        while (bencode_dict_has_next(be))
+        {
+            if (0 == bencode_dict_get_next(be, &item, &key, &klen))
+                return;
+            __walk(&item);
+        }
+    }
+    else if (bencode_is_list(be))
+    {
+        while (bencode_list_has_next(be))
+        {
+            if (1 != bencode_list_get_next(be, &item))
+                return;
+            __walk(&item);
+        }
+    }
+}
+
+/**
+ * @return bytes touched per byte of input */
+static double __work_ratio(
+    const uint8_t * data,
+    size_t size
+)
+{
+    bencode_stats_t stats;
+    bencode_t ben;
+    double ratio;
+
+    /* an exact copy, so reads past the end are caught by ASan */
+    char *buf = malloc(size ? size : 1);
+
+    memcpy(buf, data, size);
+    bencode_stats_begin(&stats);
+    if (0 < size && 0 == bencode_validate(buf, size))
+    {
+        bencode_init(&ben, buf, size);
+        __walk(&ben);
+    }
+    bencode_stats_end();
+    free(buf);
+
+    /* the walk touches bytes too, but it was only given the input once */
+    stats.input_bytes = size;
+    ratio = bencode_stats_work_ratio(&stats);
+    buckets[ratio < NBUCKETS - 1 ? (int)ratio : NBUCKETS - 1] = 1;
+    return ratio;
+}
+
+int LLVMFuzzerTestOneInput(
+    const uint8_t * data,
+    size_t size
+)
+{
+    double ratio = __work_ratio(data, size);
+
+    if (FUZZ_MAX_RATIO < ratio)
+    {
+        fprintf(stderr, "work ratio %.1f exceeds %d\n", ratio, FUZZ_MAX_RATIO);
+        abort();
+    }
+
+    return 0;
+}
+
+#ifdef FUZZ_REGRESS
+int main(
+    int argc,
+    char **argv
+)
+{
+    static uint8_t data[1 << 20];
+    int i, failed = 0;
+
+    for (i = 1; i < argc; i++)
+    {
+        FILE *fp = fopen(argv[i], "rb");
+        size_t size;
+        double ratio;
+
+        if (!fp)
+        {
+            perror(argv[i]);
+            return 1;
+        }
+        size = fread(data, 1, sizeof(data), fp);
+        fclose(fp);
+
+        ratio = __work_ratio(data, size);
+        printf("%s %s: work ratio %.1f\n",
+               FUZZ_MAX_RATIO < ratio ? "FAIL" : "ok", argv[i], ratio);
+        if (FUZZ_MAX_RATIO < ratio)
+            failed = 1;
+    }
+
+    return failed;
+}
+#endif
@@ -32,6 +32,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "CuTest.h"
 
 #include "bencode.h"
@@ -505,6 +508,54 @@ void TestBencodeListGetNextAtInvalidEnd(
     free(str);
 }
 
+void TestBencodeListGetBatch(
+    CuTest * tc
+)
+{
+    bencode_t ben, items[2];
+
+    char *str = strdup("li1e4:testli2eed1:ai3ee3:fooe");
+
+    const char *ren;
+
+    int len;
+
+    bencode_init(&ben, str, strlen(str));
+
+    CuAssertIntEquals(tc, 2, bencode_list_get_batch(&ben, items, 2));
+    CuAssertTrue(tc, bencode_is_int(&items[0]));
+    bencode_string_value(&items[1], &ren, &len);
+    CuAssertTrue(tc, !strncmp("test", ren, len));
+
+    CuAssertIntEquals(tc, 2, bencode_list_get_batch(&ben, items, 2));
+    CuAssertTrue(tc, bencode_is_list(&items[0]));
+    CuAssertTrue(tc, bencode_is_dict(&items[1]));
+
+    /* the last batch comes up short, and can be mixed with get_next */
+    CuAssertIntEquals(tc, 1, bencode_list_get_batch(&ben, items, 2));
+    bencode_string_value(&items[0], &ren, &len);
+    CuAssertTrue(tc, !strncmp("foo", ren, len));
+    CuAssertIntEquals(tc, 0, bencode_list_get_batch(&ben, items, 2));
+    CuAssertIntEquals(tc, 0, bencode_list_get_next(&ben, items));
+
+    free(str);
+}
+
+void TestBencodeListGetBatchAtInvalidEnd(
+    CuTest * tc
+)
+{
+    bencode_t ben, items[4];
+
+    char *str = strdup("l4:testg");
+
+    bencode_init(&ben, str, strlen(str));
+
+    CuAssertIntEquals(tc, -1, bencode_list_get_batch(&ben, items, 4));
+
+    free(str);
+}
+
 void TestBencodeIsDict(
     CuTest * tc
 )
@@ -692,6 +743,60 @@ void TestBencodeDictGetNextTwice(
     free(str);
 }
 
+void TestBencodeDictGetBatch(
+    CuTest * tc
+)
+{
+    bencode_t ben, ben2, items[4];
+
+    char *str = strdup("d4:test3:egg3:fooi2e3:hamle4:spamd1:xi1eee");
+
+    const char *keys[4], *ren;
+
+    int klens[4], len;
+
+    bencode_init(&ben, str, strlen(str));
+
+    /* one item the slow way, then the rest in a batch */
+    CuAssertIntEquals(tc, 1, bencode_dict_get_next(&ben, &ben2, &ren, &len));
+    CuAssertTrue(tc, !strncmp("test", ren, len));
+
+    CuAssertIntEquals(tc, 3,
+        bencode_dict_get_batch(&ben, keys, klens, items, 4));
+    CuAssertTrue(tc, !strncmp("foo", keys[0], klens[0]));
+    CuAssertTrue(tc, bencode_is_int(&items[0]));
+    CuAssertTrue(tc, !strncmp("ham", keys[1], klens[1]));
+    CuAssertTrue(tc, bencode_is_list(&items[1]));
+    CuAssertTrue(tc, !strncmp("spam", keys[2], klens[2]));
+    CuAssertTrue(tc, bencode_is_dict(&items[2]));
+
+    CuAssertIntEquals(tc, 0,
+        bencode_dict_get_batch(&ben, keys, klens, items, 4));
+    CuAssertTrue(tc, !bencode_dict_has_next(&ben));
+
+    free(str);
+}
+
+void TestBencodeDictGetBatchWontReadPastBuffer(
+    CuTest * tc
+)
+{
+    bencode_t ben, items[4];
+
+    char *str = strdup("d3:foo3:bar9:ham");
+
+    const char *keys[4];
+
+    int klens[4];
+
+    bencode_init(&ben, str, strlen(str));
+
+    CuAssertIntEquals(tc, -1,
+        bencode_dict_get_batch(&ben, keys, klens, items, 4));
+
+    free(str);
+}
+
 void TestBencodeDictGetNextTwiceOnlyIfSecondKeyValid(
     CuTest * tc
 )
@@ -879,6 +984,36 @@ void TestBencodeDictGetStartAndLen2(
     free(str);
 }
 
+void TestBencodeDictGetStartAndLenEmpty(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    const char *ren;
+    int len;
+
+    bencode_init(&ben, "de", 2);
+    bencode_dict_get_start_and_len(&ben, &ren, &len);
+    CuAssertIntEquals(tc, 2, len);
+}
+
+void TestBencodeValueEnd(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+
+    char *str = strdup("d1:ald1:bi1eee2:xye");
+
+    bencode_init(&ben, str, strlen(str));
+    CuAssertPtrEquals(tc, str + 19, (void*)bencode_value_end(&ben));
+    bencode_init(&ben, str, 15);
+    CuAssertPtrEquals(tc, NULL, (void*)bencode_value_end(&ben));
+    bencode_init(&ben, str + 4, 10);
+    CuAssertPtrEquals(tc, str + 14, (void*)bencode_value_end(&ben));
+    free(str);
+}
+
 /*----------------------------------------------------------------------------*/
 
 void TestBencodeStringValueIsZeroLength(
@@ -910,3 +1045,934 @@ void TestBencodeStringValueIsZeroLength(
 
     free(str);
 }
+
+/*----------------------------------------------------------------------------*/
+
+typedef struct
+{
+    long int length;
+    bencode_span_t name;
+    long int piece_length;
+    bencode_span_t pieces;
+} info_t;
+
+typedef struct
+{
+    bencode_span_t announce;
+    info_t info;
+} metainfo_t;
+
+static const bencode_field_t info_fields[] = {
+    BENCODE_FIELD(info_t, length, "length", BENCODE_BIND_INT),
+    BENCODE_FIELD(info_t, name, "name", BENCODE_BIND_STRING),
+    BENCODE_FIELD(info_t, piece_length, "piece length", BENCODE_BIND_INT),
+    BENCODE_FIELD(info_t, pieces, "pieces", BENCODE_BIND_STRING),
+};
+
+static const bencode_field_t metainfo_fields[] = {
+    BENCODE_FIELD(metainfo_t, announce, "announce", BENCODE_BIND_STRING),
+    BENCODE_FIELD_DICT(metainfo_t, info, "info", info_fields),
+};
+
+void TestBencodeBindMetainfo(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    metainfo_t m;
+
+    char *str = strdup("d8:announce3:url4:infod6:lengthi100e4:name3:foo"
+                       "12:piece lengthi16384e6:pieces4:abcdee");
+
+    memset(&m, 0, sizeof(m));
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 2, bencode_bind(&ben, metainfo_fields, 2, &m));
+    CuAssertTrue(tc, !strncmp("url", m.announce.str, m.announce.len));
+    CuAssertIntEquals(tc, 100, m.info.length);
+    CuAssertTrue(tc, !strncmp("foo", m.info.name.str, m.info.name.len));
+    CuAssertIntEquals(tc, 16384, m.info.piece_length);
+    CuAssertIntEquals(tc, 4, m.info.pieces.len);
+    free(str);
+}
+
+typedef struct
+{
+    long int interval;
+    bencode_t peers;
+} announce_t;
+
+static const bencode_field_t announce_fields[] = {
+    BENCODE_FIELD(announce_t, interval, "interval", BENCODE_BIND_INT),
+    BENCODE_FIELD(announce_t, peers, "peers", BENCODE_BIND_VALUE),
+};
+
+void TestBencodeBindSkipsUnknownKeys(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    announce_t a;
+
+    char *str = strdup("d8:completei5e8:intervali1800e5:peersl3:fooe"
+                       "10:tracker id3:abce");
+
+    memset(&a, 0, sizeof(a));
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 2, bencode_bind(&ben, announce_fields, 2, &a));
+    CuAssertIntEquals(tc, 1800, a.interval);
+    CuAssertTrue(tc, 1 == bencode_is_list(&a.peers));
+    free(str);
+}
+
+void TestBencodeBindLeavesMissingKeysUntouched(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    announce_t a;
+
+    char *str = strdup("d8:intervali30ee");
+
+    memset(&a, 0, sizeof(a));
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 1, bencode_bind(&ben, announce_fields, 2, &a));
+    CuAssertIntEquals(tc, 30, a.interval);
+    CuAssertPtrEquals(tc, NULL, (void*)a.peers.str);
+    free(str);
+}
+
+void TestBencodeBindFailsOnTypeMismatch(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    announce_t a;
+
+    char *str = strdup("d8:interval3:fooe");
+
+    memset(&a, 0, sizeof(a));
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, -1, bencode_bind(&ben, announce_fields, 2, &a));
+    free(str);
+}
+
+void TestBencodeBindFailsOnTruncatedDict(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    announce_t a;
+
+    char *str = strdup("d8:intervali30e3:zzzi1e");
+
+    memset(&a, 0, sizeof(a));
+    bencode_init(&ben, str, strlen("d8:intervali30e"));
+    CuAssertIntEquals(tc, -1, bencode_bind(&ben, announce_fields, 2, &a));
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, -1, bencode_bind(&ben, announce_fields, 2, &a));
+    free(str);
+}
+
+void TestBencodeListExtractInt(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    long int lengths[4];
+    int n;
+
+    char *str = strdup("ld6:lengthi10e4:pathl1:aee"
+                       "d6:lengthi20e4:pathl1:b1:cee"
+                       "d4:pathl1:deee");
+
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 1, bencode_list_extract_int(&ben, "length", 6, lengths, 4, &n));
+    CuAssertIntEquals(tc, 3, n);
+    CuAssertIntEquals(tc, 10, lengths[0]);
+    CuAssertIntEquals(tc, 20, lengths[1]);
+    CuAssertIntEquals(tc, 0, lengths[2]);
+    CuAssertIntEquals(tc, 0, bencode_list_has_next(&ben));
+    free(str);
+}
+
+void TestBencodeListExtractSpan(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    bencode_span_t paths[4];
+    int n;
+
+    char *str = strdup("ld6:lengthi10e4:pathl1:aee"
+                       "d4:name3:foo4:pathl1:b1:cee"
+                       "dee");
+
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 1, bencode_list_extract_span(&ben, "path", 4, paths, 4, &n));
+    CuAssertIntEquals(tc, 3, n);
+    CuAssertTrue(tc, !strncmp("l1:ae", paths[0].str, paths[0].len));
+    CuAssertTrue(tc, !strncmp("l1:b1:ce", paths[1].str, paths[1].len));
+    CuAssertPtrEquals(tc, NULL, (void*)paths[2].str);
+
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 1, bencode_list_extract_span(&ben, "name", 4, paths, 4, &n));
+    CuAssertTrue(tc, !strncmp("foo", paths[1].str, paths[1].len));
+    free(str);
+}
+
+void TestBencodeListExtractResumesWhenFull(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    long int lengths[2];
+    int n;
+
+    char *str = strdup("ld1:ai1eed1:ai2eed1:ai3eee");
+
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 0, bencode_list_extract_int(&ben, "a", 1, lengths, 2, &n));
+    CuAssertIntEquals(tc, 2, n);
+    CuAssertIntEquals(tc, 2, lengths[1]);
+    CuAssertIntEquals(tc, 1, bencode_list_extract_int(&ben, "a", 1, lengths, 2, &n));
+    CuAssertIntEquals(tc, 1, n);
+    CuAssertIntEquals(tc, 3, lengths[0]);
+    free(str);
+}
+
+void TestBencodeListExtractFailsOnNonDict(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    long int lengths[2];
+    int n;
+
+    char *str = strdup("ld1:ai1eei2ee");
+
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, -1, bencode_list_extract_int(&ben, "a", 1, lengths, 2, &n));
+    free(str);
+}
+
+void TestBencodeListExtractFailsOnNonList(
+    CuTest * tc
+)
+{
+    bencode_t ben, item;
+    long int lengths[4];
+    int n;
+
+    char *str = strdup("ld1:ai1eed1:ai2eee");
+
+    /* a dict within the list, followed by its sibling */
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 1, bencode_list_get_next(&ben, &item));
+    CuAssertIntEquals(tc, -1, bencode_list_extract_int(&item, "a", 1, lengths, 4, &n));
+    CuAssertIntEquals(tc, 0, n);
+    free(str);
+}
+
+void TestBencodeListToInt64Array(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    int64_t vals[8];
+    int n;
+
+    char *str = strdup("li1ei-22ei333ei123456789012ei0ei-9223372036854775807ee");
+
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 1, bencode_list_to_int64_array(&ben, vals, 8, &n));
+    CuAssertIntEquals(tc, 6, n);
+    CuAssertTrue(tc, 1 == vals[0]);
+    CuAssertTrue(tc, -22 == vals[1]);
+    CuAssertTrue(tc, 333 == vals[2]);
+    CuAssertTrue(tc, 123456789012LL == vals[3]);
+    CuAssertTrue(tc, 0 == vals[4]);
+    CuAssertTrue(tc, -9223372036854775807LL == vals[5]);
+    CuAssertIntEquals(tc, 0, bencode_list_has_next(&ben));
+    free(str);
+}
+
+void TestBencodeListToInt64ArrayFailsOnNonList(
+    CuTest * tc
+)
+{
+    bencode_t ben, item;
+    int64_t vals[8];
+    int n;
+
+    char *str = strdup("li5ei6ei7ee");
+
+    /* an int within the list mustn't read on into its siblings */
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 1, bencode_list_get_next(&ben, &item));
+    CuAssertIntEquals(tc, -1, bencode_list_to_int64_array(&item, vals, 8, &n));
+    CuAssertIntEquals(tc, 0, n);
+    free(str);
+}
+
+void TestBencodeListToInt64ArrayEmpty(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    int64_t vals[1];
+    int n;
+
+    char *str = strdup("le");
+
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 1, bencode_list_to_int64_array(&ben, vals, 1, &n));
+    CuAssertIntEquals(tc, 0, n);
+    free(str);
+}
+
+void TestBencodeListToInt64ArrayResumesWhenFull(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    int64_t vals[2];
+    int n;
+
+    char *str = strdup("li1ei2ei3ee");
+
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 0, bencode_list_to_int64_array(&ben, vals, 2, &n));
+    CuAssertIntEquals(tc, 2, n);
+    CuAssertIntEquals(tc, 1, bencode_list_to_int64_array(&ben, vals, 2, &n));
+    CuAssertIntEquals(tc, 1, n);
+    CuAssertTrue(tc, 3 == vals[0]);
+    free(str);
+}
+
+void TestBencodeListToInt64ArrayRejectsNonInts(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    int64_t vals[4];
+    int n;
+
+    char *str = strdup("li1e3:fooe");
+
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, -1, bencode_list_to_int64_array(&ben, vals, 4, &n));
+
+    bencode_init(&ben, str, 4);
+    CuAssertIntEquals(tc, -1, bencode_list_to_int64_array(&ben, vals, 4, &n));
+    free(str);
+}
+
+void TestBencodeStatsCountsValues(
+    CuTest * tc
+)
+{
+    bencode_stats_t stats;
+
+    char *str = strdup("d3:fooli1ei2ee3:bard1:a0:ee");
+
+    if (-1 == bencode_stats_begin(&stats))
+    {
+        /* built without BENCODE_STATS */
+        free(str);
+        return;
+    }
+
+    CuAssertIntEquals(tc, 0, bencode_validate(str, strlen(str)));
+    bencode_stats_end();
+
+    CuAssertIntEquals(tc, strlen(str), stats.input_bytes);
+    CuAssertIntEquals(tc, 2, stats.dicts);
+    CuAssertIntEquals(tc, 1, stats.lists);
+    CuAssertIntEquals(tc, 2, stats.ints);
+    CuAssertIntEquals(tc, 1, stats.strings);
+    CuAssertIntEquals(tc, 2, stats.max_depth);
+    CuAssertTrue(tc, 0 < stats.rescans);
+    CuAssertTrue(tc, 1.0 <= bencode_stats_work_ratio(&stats));
+    free(str);
+}
+
+void TestBencodeStatsWorkRatioWithoutInput(
+    CuTest * tc
+)
+{
+    bencode_stats_t stats;
+
+    memset(&stats, 0, sizeof(stats));
+    CuAssertTrue(tc, 0 == bencode_stats_work_ratio(&stats));
+}
+
+void TestBencodeBudgetUnlimitedValidates(
+    CuTest * tc
+)
+{
+    bencode_budget_t budget;
+
+    char *str = strdup("d3:fooli1ei2ee3:bard1:a0:ee");
+
+    memset(&budget, 0, sizeof(budget));
+    CuAssertIntEquals(tc, 0, bencode_validate_budget(str, strlen(str), &budget));
+    CuAssertIntEquals(tc, 0, budget.exceeded);
+    CuAssertTrue(tc, 0 < budget.bytes);
+    CuAssertIntEquals(tc, 5, budget.values);
+    free(str);
+}
+
+void TestBencodeBudgetMaxBytes(
+    CuTest * tc
+)
+{
+    bencode_budget_t budget;
+
+    char *str = strdup("llllllllllllllllllllllllllllllleeeeeeeeeeeeeeeeeeeeeeeeeeeeeee");
+
+    /* each level is skipped over once by its parent, so this costs about
+     * 900 bytes of scanning */
+    memset(&budget, 0, sizeof(budget));
+    budget.max_bytes = 500;
+    CuAssertIntEquals(tc, BENCODE_ERR_BUDGET, bencode_validate_budget(str, strlen(str), &budget));
+    CuAssertIntEquals(tc, 1, budget.exceeded);
+    free(str);
+}
+
+void TestBencodeBudgetMaxValues(
+    CuTest * tc
+)
+{
+    bencode_budget_t budget;
+
+    char *str = strdup("li1ei2ei3ei4ee");
+
+    memset(&budget, 0, sizeof(budget));
+    budget.max_values = 3;
+    CuAssertIntEquals(tc, BENCODE_ERR_BUDGET, bencode_validate_budget(str, strlen(str), &budget));
+    budget.max_values = 4;
+    budget.values = 0;
+    budget.exceeded = 0;
+    CuAssertIntEquals(tc, 0, bencode_validate_budget(str, strlen(str), &budget));
+    free(str);
+}
+
+void TestBencodeBudgetMaxString(
+    CuTest * tc
+)
+{
+    bencode_budget_t budget;
+
+    char *str = strdup("l3:foo10:0123456789e");
+
+    memset(&budget, 0, sizeof(budget));
+    budget.max_string = 5;
+    CuAssertIntEquals(tc, BENCODE_ERR_BUDGET, bencode_validate_budget(str, strlen(str), &budget));
+    free(str);
+}
+
+void TestBencodeBudgetMaxDepth(
+    CuTest * tc
+)
+{
+    bencode_budget_t budget;
+
+    char *str = strdup("llli1eeee");
+
+    memset(&budget, 0, sizeof(budget));
+    budget.max_depth = 2;
+    CuAssertIntEquals(tc, BENCODE_ERR_BUDGET, bencode_validate_budget(str, strlen(str), &budget));
+    memset(&budget, 0, sizeof(budget));
+    budget.max_depth = 3;
+    CuAssertIntEquals(tc, 0, bencode_validate_budget(str, strlen(str), &budget));
+    free(str);
+}
+
+void TestBencodeBudgetStopsIterators(
+    CuTest * tc
+)
+{
+    bencode_budget_t budget;
+    bencode_t ben, item;
+
+    char *str = strdup("li1ei2ei3ee");
+
+    memset(&budget, 0, sizeof(budget));
+    budget.max_values = 2;
+    bencode_init(&ben, str, strlen(str));
+    bencode_set_budget(&ben, &budget);
+    CuAssertIntEquals(tc, 1, bencode_list_get_next(&ben, &item));
+    CuAssertPtrEquals(tc, &budget, item.budget);
+    CuAssertIntEquals(tc, 1, bencode_list_get_next(&ben, &item));
+    CuAssertIntEquals(tc, -1, bencode_list_get_next(&ben, &item));
+    CuAssertIntEquals(tc, 1, budget.exceeded);
+    free(str);
+}
+
+void TestBencodeInvalidIsNotOverBudget(
+    CuTest * tc
+)
+{
+    bencode_budget_t budget;
+
+    char *str = strdup("l4:testg");
+
+    memset(&budget, 0, sizeof(budget));
+    CuAssertIntEquals(tc, BENCODE_ERR_INVALID, bencode_validate_budget(str, strlen(str), &budget));
+    free(str);
+}
+
+enum {
+    KEY_A,
+    KEY_Q,
+    KEY_R,
+    KEY_T,
+    KEY_Y,
+    KEY_INFO_HASH
+};
+
+static const char *const dht_keys[] = { "a", "q", "r", "t", "y", "info_hash" };
+
+void TestBencodeKeysetLookup(
+    CuTest * tc
+)
+{
+    bencode_keyset_t ks;
+
+    CuAssertIntEquals(tc, 0, bencode_keyset_init(&ks, dht_keys, 6));
+    CuAssertIntEquals(tc, KEY_A, bencode_keyset_lookup(&ks, "a", 1));
+    CuAssertIntEquals(tc, KEY_Y, bencode_keyset_lookup(&ks, "y", 1));
+    CuAssertIntEquals(tc, KEY_INFO_HASH, bencode_keyset_lookup(&ks, "info_hash", 9));
+    CuAssertIntEquals(tc, -1, bencode_keyset_lookup(&ks, "info", 4));
+    CuAssertIntEquals(tc, -1, bencode_keyset_lookup(&ks, "info_hashx", 10));
+    CuAssertIntEquals(tc, -1, bencode_keyset_lookup(&ks, "", 0));
+
+    /* keys can hold a NUL, which mustn't end the comparison early */
+    CuAssertIntEquals(tc, -1, bencode_keyset_lookup(&ks, "a\0zz", 4));
+}
+
+void TestBencodeKeysetRejectsDuplicates(
+    CuTest * tc
+)
+{
+    bencode_keyset_t ks;
+    const char *const keys[] = { "a", "b", "a" };
+
+    CuAssertIntEquals(tc, -1, bencode_keyset_init(&ks, keys, 3));
+}
+
+void TestBencodeDictGetNextId(
+    CuTest * tc
+)
+{
+    bencode_keyset_t ks;
+    bencode_t ben, item;
+    const char *key;
+    int klen, id, seen = 0;
+
+    char *str = strdup("d1:ad2:id3:abce1:q4:ping1:t2:aa1:v4:LT011:y1:qe");
+
+    bencode_keyset_init(&ks, dht_keys, 6);
+    bencode_init(&ben, str, strlen(str));
+    while (bencode_dict_has_next(&ben))
+    {
+        CuAssertIntEquals(tc, 1, bencode_dict_get_next_id(&ben, &item, &key,
+                                                          &klen, &ks, &id));
+        switch (id)
+        {
+        case KEY_A:
+            CuAssertTrue(tc, bencode_is_dict(&item));
+            seen |= 1;
+            break;
+        case KEY_Q:
+        case KEY_T:
+        case KEY_Y:
+            CuAssertTrue(tc, bencode_is_string(&item));
+            seen |= 2;
+            break;
+        case -1:
+            CuAssertTrue(tc, !strncmp("v", key, klen));
+            seen |= 4;
+            break;
+        default:
+            CuFail(tc, "unexpected key");
+        }
+    }
+    CuAssertIntEquals(tc, 7, seen);
+    free(str);
+}
+
+void TestBencodeDictGetNextIdWithoutOutParams(
+    CuTest * tc
+)
+{
+    bencode_keyset_t ks;
+    bencode_t ben;
+    int id;
+
+    char *str = strdup("d1:q4:ping1:v4:LT01e");
+
+    bencode_keyset_init(&ks, dht_keys, 6);
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 1,
+        bencode_dict_get_next_id(&ben, NULL, NULL, NULL, &ks, &id));
+    CuAssertIntEquals(tc, KEY_Q, id);
+    CuAssertIntEquals(tc, 1,
+        bencode_dict_get_next_id(&ben, NULL, NULL, NULL, &ks, &id));
+    CuAssertIntEquals(tc, -1, id);
+    CuAssertTrue(tc, !bencode_dict_has_next(&ben));
+    free(str);
+}
+
+/**
+ * Put a string right before a page that can't be read, so that reading past
+ * its end faults */
+static char *__guarded(
+    const char *str,
+    int len,
+    void **map,
+    size_t *maplen
+)
+{
+    long int page = sysconf(_SC_PAGESIZE);
+    char *mem;
+
+    *maplen = page * 2;
+    *map = mmap(NULL, *maplen, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    mem = *map;
+    mprotect(mem + page, page, PROT_NONE);
+    memcpy(mem + page - len, str, len);
+    return mem + page - len;
+}
+
+static void __walk(
+    bencode_t * be
+)
+{
+    bencode_t item;
+    const char *key, *str;
+    long int val;
+    int klen, len;
+
+    if (bencode_is_dict(be))
+    {
+        while (bencode_dict_has_next(be))
+        {
+            if (0 == bencode_dict_get_next(be, &item, &key, &klen))
+                return;
+            __walk(&item);
+        }
+    }
+    else if (bencode_is_list(be))
+    {
+        while (bencode_list_has_next(be))
+        {
+            if (1 != bencode_list_get_next(be, &item))
+                return;
+            __walk(&item);
+        }
+    }
+    else if (bencode_is_string(be))
+        bencode_string_value(be, &str, &len);
+    else if (bencode_is_int(be))
+        bencode_int_value(be, &val);
+}
+
+void TestBencodeNeverReadsPastLength(
+    CuTest * tc
+)
+{
+    const char *msg = "d1:ad2:id20:abcdefghij01234567899:info_hash"
+        "20:mnopqrstuvwxyz123456e1:q9:get_peers1:t2:aa1:y1:q"
+        "5:nodesli1ei-22eli333eed1:xi123456789012eeee";
+    int len = strlen(msg), i;
+
+    for (i = 0; i <= len; i++)
+    {
+        bencode_t ben;
+        void *map;
+        size_t maplen;
+        char *buf = __guarded(msg, i, &map, &maplen);
+
+        /* every prefix is cut short, apart from the whole message; an
+         * empty buffer counts as valid */
+        if (0 < i)
+            CuAssertIntEquals(tc, i == len ? 0 : -1,
+                              bencode_validate(buf, i) ? -1 : 0);
+
+        bencode_init(&ben, buf, i);
+        __walk(&ben);
+        munmap(map, maplen);
+    }
+}
+
+void TestBencodePaddingIsNotInput(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    long int val;
+    int64_t vals[4];
+    int n;
+    char str[32] = "i12345678";
+
+    /* the digits carry on, and the terminator is, in the padding */
+    strcpy(str + 9, "90e");
+    bencode_init_padded(&ben, str, 9);
+    CuAssertIntEquals(tc, 0, bencode_int_value(&ben, &val));
+
+    bencode_init_padded(&ben, str, 12);
+    CuAssertIntEquals(tc, 1, bencode_int_value(&ben, &val));
+    CuAssertTrue(tc, 1234567890 == val);
+
+    strcpy(str, "li1234567890123ei-5ee");
+    bencode_init_padded(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 1, bencode_list_to_int64_array(&ben, vals, 4, &n));
+    CuAssertIntEquals(tc, 2, n);
+    CuAssertTrue(tc, 1234567890123LL == vals[0]);
+    CuAssertTrue(tc, -5 == vals[1]);
+}
+
+void TestBencodeIntValueOverflowIsInvalid(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    long int val;
+    char *str = strdup("i9223372036854775808e");
+
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 0, bencode_int_value(&ben, &val));
+    CuAssertIntEquals(tc, -1, bencode_validate(str, strlen(str)));
+    free(str);
+}
+
+void TestBencodeIntValueLeadingZerosDontCount(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    long int val;
+    char one[] = "i00000000000000000000001e",
+         min[] = "i-09223372036854775808e",
+         zero[] = "i0000000000000000000000e",
+         over[] = "i09223372036854775808e",
+         len[] = "00000000000000000000003:abc";
+    const char *str;
+    int slen;
+
+    bencode_init(&ben, one, strlen(one));
+    CuAssertIntEquals(tc, 1, bencode_int_value(&ben, &val));
+    CuAssertTrue(tc, 1 == val);
+    CuAssertIntEquals(tc, 0, bencode_validate(one, strlen(one)));
+
+    bencode_init(&ben, min, strlen(min));
+    CuAssertIntEquals(tc, 1, bencode_int_value(&ben, &val));
+    CuAssertTrue(tc, LONG_MIN == val);
+    CuAssertIntEquals(tc, 0, bencode_validate(min, strlen(min)));
+
+    bencode_init(&ben, zero, strlen(zero));
+    CuAssertIntEquals(tc, 1, bencode_int_value(&ben, &val));
+    CuAssertTrue(tc, 0 == val);
+
+    CuAssertIntEquals(tc, -1, bencode_validate(over, strlen(over)));
+
+    bencode_init(&ben, len, strlen(len));
+    CuAssertIntEquals(tc, 1, bencode_string_value(&ben, &str, &slen));
+    CuAssertIntEquals(tc, 3, slen);
+}
+
+void TestBencodeValidateUnterminated(
+    CuTest * tc
+)
+{
+    char dict[] = "d1:ai1e", list[] = "li1e", empty[] = "dele";
+
+    CuAssertIntEquals(tc, -1, bencode_validate(dict, strlen(dict)));
+    CuAssertIntEquals(tc, -1, bencode_validate(list, strlen(list)));
+    CuAssertIntEquals(tc, 0, bencode_validate(empty, 2));
+    CuAssertIntEquals(tc, 0, bencode_validate(empty + 2, 2));
+}
+
+void TestBencodeStringIsUtf8(
+    CuTest * tc
+)
+{
+    CuAssertIntEquals(tc, 1, bencode_string_is_utf8("", 0));
+    CuAssertIntEquals(tc, 1, bencode_string_is_utf8("plain ascii, long enough", 24));
+    /* é, € and 😀 */
+    CuAssertIntEquals(tc, 1, bencode_string_is_utf8("caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80!", 15));
+    /* lone continuation byte */
+    CuAssertIntEquals(tc, 0, bencode_string_is_utf8("abcdefgh\x80", 9));
+    /* overlong '/' */
+    CuAssertIntEquals(tc, 0, bencode_string_is_utf8("\xc0\xaf", 2));
+    CuAssertIntEquals(tc, 0, bencode_string_is_utf8("\xe0\x80\xaf", 3));
+    /* UTF-16 surrogate */
+    CuAssertIntEquals(tc, 0, bencode_string_is_utf8("\xed\xa0\x80", 3));
+    /* past U+10FFFF */
+    CuAssertIntEquals(tc, 0, bencode_string_is_utf8("\xf4\x90\x80\x80", 4));
+    /* cut short */
+    CuAssertIntEquals(tc, 0, bencode_string_is_utf8("\xe2\x82", 2));
+}
+
+typedef struct
+{
+    int n;
+    const char *last;
+} binary_count_t;
+
+static void __count_binary(
+    void *udata,
+    const char *str,
+    int len
+)
+{
+    binary_count_t *c = udata;
+
+    (void)len;
+    c->n++;
+    c->last = str;
+}
+
+void TestBencodeValidateUtf8ReportsBinary(
+    CuTest * tc
+)
+{
+    binary_count_t count = { 0, NULL };
+    char str[] = "d4:name6:caf\xc3\xa9!6:pieces4:\xff\x00\x01\x02"
+        "4:pathl3:abc2:\xc3\x28" "ee";
+    int len = sizeof(str) - 1;
+
+    CuAssertIntEquals(tc, 0, bencode_validate_utf8(str, len, __count_binary, &count));
+    CuAssertIntEquals(tc, 2, count.n);
+    CuAssertPtrEquals(tc, str + len - 4, (void*)count.last);
+}
+
+static const bencode_schema_t schema_file_fields[] = {
+    { "length", 6, BENCODE_SCHEMA_INT,
+      BENCODE_SCHEMA_REQUIRED | BENCODE_SCHEMA_MIN, .min = 0 },
+    { "path", 4, BENCODE_SCHEMA_LIST,
+      BENCODE_SCHEMA_REQUIRED | BENCODE_SCHEMA_MIN, .min = 1,
+      .sub = (const bencode_schema_t[]) {
+          BENCODE_SCHEMA("", BENCODE_SCHEMA_STRING, 0) }, .nsub = 1 }
+};
+
+static const bencode_schema_t schema_file_entry[] = {
+    BENCODE_SCHEMA_SUB("", BENCODE_SCHEMA_DICT, 0, schema_file_fields)
+};
+
+static const bencode_schema_t schema_info_fields[] = {
+    BENCODE_SCHEMA_SUB("files", BENCODE_SCHEMA_LIST, 0, schema_file_entry),
+    BENCODE_SCHEMA("length", BENCODE_SCHEMA_INT, 0),
+    BENCODE_SCHEMA("name", BENCODE_SCHEMA_STRING, BENCODE_SCHEMA_REQUIRED),
+    { "piece length", 12, BENCODE_SCHEMA_INT,
+      BENCODE_SCHEMA_REQUIRED | BENCODE_SCHEMA_MIN, .min = 1 },
+    { "pieces", 6, BENCODE_SCHEMA_STRING, BENCODE_SCHEMA_REQUIRED,
+      .multiple = 20 }
+};
+
+static const bencode_schema_t schema_torrent_fields[] = {
+    BENCODE_SCHEMA("announce", BENCODE_SCHEMA_STRING, 0),
+    BENCODE_SCHEMA_SUB("info", BENCODE_SCHEMA_DICT, BENCODE_SCHEMA_REQUIRED,
+                       schema_info_fields)
+};
+
+static const bencode_schema_t torrent_schema =
+    BENCODE_SCHEMA_SUB("", BENCODE_SCHEMA_DICT, 0, schema_torrent_fields);
+
+void TestBencodeSchemaValidateMatches(
+    CuTest * tc
+)
+{
+    char *str = strdup("d8:announce3:url7:comment2:hi4:infod5:filesld6:lengthi5e"
+                       "4:pathl1:a1:beee4:name1:x12:piece lengthi16e"
+                       "6:pieces20:01234567890123456789ee");
+    const char *err = NULL;
+
+    CuAssertIntEquals(tc, 0, bencode_schema_validate(str, strlen(str),
+                                                     &torrent_schema, &err));
+    CuAssertPtrEquals(tc, NULL, (void*)err);
+    free(str);
+}
+
+void TestBencodeSchemaValidateMissingRequired(
+    CuTest * tc
+)
+{
+    char *str = strdup("d4:infod4:name1:x6:pieces20:01234567890123456789ee");
+    const char *err = NULL;
+
+    CuAssertIntEquals(tc, -1, bencode_schema_validate(str, strlen(str),
+                                                      &torrent_schema, &err));
+    /* reported at the end of the dict missing "piece length" */
+    CuAssertPtrEquals(tc, str + strlen(str) - 2, (void*)err);
+    free(str);
+}
+
+void TestBencodeSchemaValidateWrongShape(
+    CuTest * tc
+)
+{
+    char *pieces = strdup("d4:infod4:name1:x12:piece lengthi16e"
+                          "6:pieces19:0123456789012345678ee");
+    char *path = strdup("d4:infod5:filesld6:lengthi5e4:pathli1eeee"
+                        "4:name1:x12:piece lengthi16e6:pieces0:ee");
+    char *zero = strdup("d4:infod4:name1:x12:piece lengthi0e6:pieces0:ee");
+    const char *err = NULL;
+
+    CuAssertIntEquals(tc, -1, bencode_schema_validate(pieces, strlen(pieces),
+                                                      &torrent_schema, &err));
+    CuAssertPtrEquals(tc, strstr(pieces, "19:"), (void*)err);
+
+    CuAssertIntEquals(tc, -1, bencode_schema_validate(path, strlen(path),
+                                                      &torrent_schema, &err));
+    CuAssertPtrEquals(tc, strstr(path, "i1e"), (void*)err);
+
+    CuAssertIntEquals(tc, -1, bencode_schema_validate(zero, strlen(zero),
+                                                      &torrent_schema, &err));
+    free(pieces);
+    free(path);
+    free(zero);
+}
+
+static const bencode_schema_t schema_bounds_fields[] = {
+    BENCODE_SCHEMA("any", BENCODE_SCHEMA_INT, 0),
+    { "none", 4, BENCODE_SCHEMA_LIST, BENCODE_SCHEMA_MAX, .max = 0 }
+};
+
+static const bencode_schema_t schema_bounds =
+    BENCODE_SCHEMA_SUB("", BENCODE_SCHEMA_DICT, 0, schema_bounds_fields);
+
+void TestBencodeSchemaValidateBounds(
+    CuTest * tc
+)
+{
+    char *neg = strdup("d3:anyi-1ee");
+    char *empty = strdup("d4:nonelee");
+    char *one = strdup("d4:noneli1eee");
+
+    /* ints are unbounded unless asked for */
+    CuAssertIntEquals(tc, 0, bencode_schema_validate(neg, strlen(neg),
+                                                     &schema_bounds, NULL));
+
+    /* an upper bound of 0 is a bound */
+    CuAssertIntEquals(tc, 0, bencode_schema_validate(empty, strlen(empty),
+                                                     &schema_bounds, NULL));
+    CuAssertIntEquals(tc, -1, bencode_schema_validate(one, strlen(one),
+                                                      &schema_bounds, NULL));
+    free(neg);
+    free(empty);
+    free(one);
+}
+
+void TestBencodeSchemaValidateUnknownKeysMustBeWellFormed(
+    CuTest * tc
+)
+{
+    char *str = strdup("d5:extrai1x4:infod4:name1:x12:piece lengthi1e6:pieces0:ee");
+
+    CuAssertIntEquals(tc, -1, bencode_schema_validate(str, strlen(str),
+                                                      &torrent_schema, NULL));
+    free(str);
+}
@@ -0,0 +1,169 @@
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "CuTest.h"
+
+#include "bencode_cache.h"
+
+static const uint64_t __key[2] = { 0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL };
+
+void TestBencodeCacheValidate(
+    CuTest * tc
+)
+{
+    bencode_cache_t cache;
+    bencode_cache_entry_t entries[8];
+    char good[] = "d1:ad2:id3:abce1:q4:ping1:t2:aa1:y1:qe";
+    char bad[] = "d1:ax";
+    int i, used = 0;
+
+    bencode_cache_init(&cache, entries, 8, NULL, 0, __key);
+    CuAssertIntEquals(tc, 0, bencode_cache_validate(&cache, good, strlen(good)));
+    CuAssertIntEquals(tc, -1, bencode_cache_validate(&cache, bad, strlen(bad)));
+
+    for (i = 0; i < 8; i++)
+        used += 0 != entries[i].seq;
+    CuAssertTrue(tc, 0 < used);
+
+    /* repeats come from the cache */
+    CuAssertIntEquals(tc, 0, bencode_cache_validate(&cache, good, strlen(good)));
+    CuAssertIntEquals(tc, -1, bencode_cache_validate(&cache, bad, strlen(bad)));
+}
+
+void TestBencodeCacheIndexIsReusedForCopies(
+    CuTest * tc
+)
+{
+    bencode_cache_t cache;
+    bencode_cache_entry_t entries[4];
+    bencode_sindex_t idx;
+    uint64_t slots[4 * 32], mem[32];
+    char a[] = "d3:keyl4:test3:fooe3:food1:ai1eee";
+    char b[sizeof(a)];
+
+    memcpy(b, a, sizeof(a));
+    bencode_cache_init(&cache, entries, 4, slots, sizeof(slots) / 4, __key);
+
+    CuAssertIntEquals(tc, 0, bencode_cache_index(&cache, &idx, mem, sizeof(mem),
+                                                 a, strlen(a)));
+    CuAssertPtrEquals(tc, a + 19, (void*)bencode_sindex_value_end(&idx, a + 6));
+
+    /* same bytes at another address */
+    memset(mem, 0, sizeof(mem));
+    CuAssertIntEquals(tc, 0, bencode_cache_index(&cache, &idx, mem, sizeof(mem),
+                                                 b, strlen(b)));
+    CuAssertPtrEquals(tc, b + 19, (void*)bencode_sindex_value_end(&idx, b + 6));
+    CuAssertPtrEquals(tc, b + 24, (void*)bencode_sindex_child(&idx, b, 3));
+}
+
+void TestBencodeCacheRemembersInvalidIndex(
+    CuTest * tc
+)
+{
+    bencode_cache_t cache;
+    bencode_cache_entry_t entries[4];
+    bencode_sindex_t idx;
+    uint64_t slots[4 * 32], mem[32];
+    char bad[] = "d3:keyl4:test";
+
+    bencode_cache_init(&cache, entries, 4, slots, sizeof(slots) / 4, __key);
+    CuAssertIntEquals(tc, -1, bencode_cache_index(&cache, &idx, mem,
+                                                  sizeof(mem), bad, strlen(bad)));
+    CuAssertIntEquals(tc, -1, bencode_cache_validate(&cache, bad, strlen(bad)));
+}
+
+void TestBencodeCacheDoesNotConfuseLengths(
+    CuTest * tc
+)
+{
+    bencode_cache_t cache;
+    bencode_cache_entry_t entries[1];
+    char buf[] = "3:abc";
+
+    /* a single entry means every buffer competes for it */
+    bencode_cache_init(&cache, entries, 1, NULL, 0, __key);
+    CuAssertIntEquals(tc, 0, bencode_cache_validate(&cache, buf, 5));
+    CuAssertIntEquals(tc, -1, bencode_cache_validate(&cache, buf, 4));
+    CuAssertIntEquals(tc, 0, bencode_cache_validate(&cache, buf, 5));
+}
+
+typedef struct
+{
+    bencode_cache_t *cache;
+    int errors;
+} cache_worker_t;
+
+static void *__cache_worker(
+    void *arg
+)
+{
+    cache_worker_t *w = arg;
+    char bufs[4][32] = { "l4:spami42ee", "d3:cow3:mooe", "li1ei2e", "3:abc" };
+    int expect[4] = { 0, 0, -1, 0 };
+    uint64_t mem[32];
+    bencode_sindex_t idx;
+    int i;
+
+    for (i = 0; i < 20000; i++)
+    {
+        int b = i % 4;
+
+        if (expect[b] != bencode_cache_validate(w->cache, bufs[b],
+                                                strlen(bufs[b])))
+            w->errors++;
+        if (expect[b] != bencode_cache_index(w->cache, &idx, mem, sizeof(mem),
+                                             bufs[b], strlen(bufs[b])))
+            w->errors++;
+        else if (0 == expect[b] &&
+                 bufs[b] + strlen(bufs[b]) !=
+                 bencode_sindex_value_end(&idx, bufs[b]))
+            w->errors++;
+    }
+
+    return NULL;
+}
+
+void TestBencodeCacheConcurrentReaders(
+    CuTest * tc
+)
+{
+    bencode_cache_t cache;
+    bencode_cache_entry_t entries[2];
+    uint64_t slots[2 * 32];
+    cache_worker_t w[4];
+    pthread_t t[4];
+    int i;
+
+    /* fewer entries than buffers keeps entries being rewritten */
+    bencode_cache_init(&cache, entries, 2, slots, sizeof(slots) / 2, __key);
+    for (i = 0; i < 4; i++)
+    {
+        w[i].cache = &cache;
+        w[i].errors = 0;
+        pthread_create(&t[i], NULL, __cache_worker, &w[i]);
+    }
+    for (i = 0; i < 4; i++)
+    {
+        pthread_join(t[i], NULL);
+        CuAssertIntEquals(tc, 0, w[i].errors);
+    }
+}
+
+void TestBencodeCacheWithoutEntries(
+    CuTest * tc
+)
+{
+    bencode_cache_t cache;
+    bencode_cache_entry_t entries[1];
+    char good[] = "d1:ai1ee";
+
+    /* nothing is cached, but buffers are still validated */
+    bencode_cache_init(&cache, entries, 0, NULL, 0, __key);
+    CuAssertIntEquals(tc, 0, bencode_cache_validate(&cache, good, strlen(good)));
+    CuAssertIntEquals(tc, 0, bencode_cache_validate(&cache, good, strlen(good)));
+    CuAssertIntEquals(tc, -1, bencode_cache_validate(&cache, good, 4));
+}
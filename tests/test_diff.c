@@ -0,0 +1,122 @@
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "CuTest.h"
+
+#include "bencode_diff.h"
+
+typedef struct
+{
+    int n;
+    char out[8][64];
+} diffs_t;
+
+/**
+ * Record each difference as "<change> <path> <a> <b>" */
+static void __record(
+    void *udata,
+    int change,
+    const bencode_path_t * path,
+    int depth,
+    const bencode_span_t * a,
+    const bencode_span_t * b
+)
+{
+    diffs_t *d = udata;
+    char *o = d->out[d->n++];
+    int i;
+
+    o += sprintf(o, "%c ", "+-~"[change]);
+    for (i = 0; i < depth; i++)
+    {
+        if (path[i].key)
+            o += sprintf(o, "/%.*s", path[i].len, path[i].key);
+        else
+            o += sprintf(o, "/%d", path[i].len);
+    }
+    sprintf(o, " %.*s %.*s", a ? a->len : 0, a ? a->str : "",
+            b ? b->len : 0, b ? b->str : "");
+}
+
+static int __diff(
+    const char *a,
+    const char *b,
+    diffs_t * d
+)
+{
+    bencode_t ba, bb;
+
+    memset(d, 0, sizeof(diffs_t));
+    bencode_init(&ba, a, strlen(a));
+    bencode_init(&bb, b, strlen(b));
+    return bencode_diff(&ba, &bb, __record, d);
+}
+
+void TestBencodeDiffIdentical(
+    CuTest * tc
+)
+{
+    diffs_t d;
+
+    CuAssertIntEquals(tc, 0, __diff("d1:ai1e1:bl1:xee", "d1:ai1e1:bl1:xee", &d));
+}
+
+void TestBencodeDiffDictKeys(
+    CuTest * tc
+)
+{
+    diffs_t d;
+
+    CuAssertIntEquals(tc, 3, __diff("d1:ai1e1:bi2e1:ci3ee",
+                                    "d1:bi2e1:ci4e1:di5ee", &d));
+    CuAssertStrEquals(tc, "- /a i1e ", d.out[0]);
+    CuAssertStrEquals(tc, "~ /c i3e i4e", d.out[1]);
+    CuAssertStrEquals(tc, "+ /d  i5e", d.out[2]);
+}
+
+void TestBencodeDiffNested(
+    CuTest * tc
+)
+{
+    diffs_t d;
+
+    CuAssertIntEquals(tc, 2, __diff("d4:infod5:filesl1:x1:yee4:name1:ne",
+                                    "d4:infod5:filesl1:x1:z1:wee4:name1:ne",
+                                    &d));
+    CuAssertStrEquals(tc, "~ /info/files/1 1:y 1:z", d.out[0]);
+    CuAssertStrEquals(tc, "+ /info/files/2  1:w", d.out[1]);
+}
+
+void TestBencodeDiffTypeChange(
+    CuTest * tc
+)
+{
+    diffs_t d;
+
+    CuAssertIntEquals(tc, 1, __diff("d1:ali1eee", "d1:ad1:bi1eee", &d));
+    CuAssertStrEquals(tc, "~ /a li1ee d1:bi1ee", d.out[0]);
+}
+
+void TestBencodeDiffInvalid(
+    CuTest * tc
+)
+{
+    diffs_t d;
+
+    CuAssertIntEquals(tc, -1, __diff("d1:ai1e", "d1:ai2ee", &d));
+    CuAssertIntEquals(tc, -1, __diff("xyz", "abc", &d));
+    CuAssertIntEquals(tc, -1, __diff("i1e", "i2", &d));
+}
+
+void TestBencodeDiffIgnoresTrailingBytes(
+    CuTest * tc
+)
+{
+    diffs_t d;
+
+    CuAssertIntEquals(tc, 0, __diff("i1ejunk", "i1e", &d));
+    CuAssertIntEquals(tc, 1, __diff("i1ejunk", "i2e", &d));
+    CuAssertStrEquals(tc, "~  i1e i2e", d.out[0]);
+}
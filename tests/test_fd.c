@@ -0,0 +1,71 @@
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "CuTest.h"
+
+#include "bencode_fd.h"
+
+void TestBencodeStringIovec(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    struct iovec iov;
+    char *str = strdup("5:hello");
+
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 1, bencode_string_iovec(&ben, &iov));
+    CuAssertPtrEquals(tc, str + 2, iov.iov_base);
+    CuAssertIntEquals(tc, 5, iov.iov_len);
+    free(str);
+}
+
+void TestBencodeStringIovecNotString(
+    CuTest * tc
+)
+{
+    bencode_t ben;
+    struct iovec iov;
+    char *str = strdup("i5e");
+
+    bencode_init(&ben, str, strlen(str));
+    CuAssertIntEquals(tc, 0, bencode_string_iovec(&ben, &iov));
+    free(str);
+}
+
+void TestBencodeStringSendfile(
+    CuTest * tc
+)
+{
+    const char *str = "d4:blob11:hello world4:sizei11ee";
+    char path[] = "/tmp/bencode_fd_XXXXXX";
+    bencode_t ben, item;
+    const char *key, *map;
+    char out[32];
+    int fd, klen, pipefd[2];
+
+    fd = mkstemp(path);
+    CuAssertTrue(tc, (ssize_t)strlen(str) == write(fd, str, strlen(str)));
+    map = mmap(NULL, strlen(str), PROT_READ, MAP_SHARED, fd, 0);
+    CuAssertTrue(tc, MAP_FAILED != map);
+
+    bencode_init(&ben, map, strlen(str));
+    bencode_dict_get_next(&ben, &item, &key, &klen);
+    CuAssertTrue(tc, !strncmp("blob", key, klen));
+
+    CuAssertIntEquals(tc, 0, pipe(pipefd));
+    CuAssertIntEquals(tc, 11, bencode_string_sendfile(&item, map, fd, pipefd[1], 0));
+    CuAssertIntEquals(tc, 5, bencode_string_sendfile(&item, map, fd, pipefd[1], 6));
+    CuAssertIntEquals(tc, 16, read(pipefd[0], out, sizeof(out)));
+    CuAssertTrue(tc, !strncmp("hello worldworld", out, 16));
+
+    close(pipefd[0]);
+    close(pipefd[1]);
+    munmap((void*)map, strlen(str));
+    close(fd);
+    unlink(path);
+}
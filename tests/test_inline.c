@@ -0,0 +1,36 @@
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "CuTest.h"
+
+#define BENCODE_HEADER_ONLY
+#include "bencode.h"
+
+void TestBencodeHeaderOnlyPredicates(
+    CuTest * tc
+)
+{
+    bencode_t ben, item;
+    const char *key;
+    int klen;
+    char *str = strdup("d3:intli1ee3:str4:spam3:dicd1:ai1eee");
+
+    bencode_init(&ben, str, strlen(str));
+    CuAssertTrue(tc, bencode_is_dict(&ben));
+    CuAssertTrue(tc, bencode_dict_has_next(&ben));
+
+    bencode_dict_get_next(&ben, &item, &key, &klen);
+    CuAssertTrue(tc, bencode_is_list(&item));
+    CuAssertTrue(tc, bencode_list_has_next(&item));
+
+    bencode_dict_get_next(&ben, &item, &key, &klen);
+    CuAssertTrue(tc, bencode_is_string(&item));
+    CuAssertTrue(tc, !bencode_is_int(&item));
+
+    bencode_dict_get_next(&ben, &item, &key, &klen);
+    CuAssertTrue(tc, bencode_is_dict(&item));
+    CuAssertTrue(tc, !bencode_dict_has_next(&ben));
+    free(str);
+}
@@ -0,0 +1,192 @@
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "CuTest.h"
+
+#include "bencode_iov.h"
+
+static void __set(
+    struct iovec *iov,
+    const char *str
+)
+{
+    iov->iov_base = (void*)str;
+    iov->iov_len = strlen(str);
+}
+
+void TestBencodeIovSingleSegment(
+    CuTest * tc
+)
+{
+    bencode_iov_t it;
+    bencode_iov_token_t tok;
+    struct iovec iov[1];
+
+    __set(&iov[0], "d3:fooi42ee");
+    bencode_iov_init(&it, iov, 1, NULL, 0);
+
+    CuAssertIntEquals(tc, 1, bencode_iov_next(&it, &tok));
+    CuAssertIntEquals(tc, BENCODE_IOV_DICT, tok.type);
+    CuAssertIntEquals(tc, 1, bencode_iov_next(&it, &tok));
+    CuAssertIntEquals(tc, BENCODE_IOV_STRING, tok.type);
+    CuAssertTrue(tc, !strncmp("foo", tok.str[0], tok.len[0]));
+    CuAssertIntEquals(tc, 0, tok.len[1]);
+    CuAssertIntEquals(tc, 1, bencode_iov_next(&it, &tok));
+    CuAssertIntEquals(tc, BENCODE_IOV_INT, tok.type);
+    CuAssertIntEquals(tc, 42, tok.val);
+    CuAssertIntEquals(tc, 1, bencode_iov_next(&it, &tok));
+    CuAssertIntEquals(tc, BENCODE_IOV_END, tok.type);
+    CuAssertIntEquals(tc, 0, bencode_iov_next(&it, &tok));
+}
+
+void TestBencodeIovStringStraddlesTwoSegments(
+    CuTest * tc
+)
+{
+    bencode_iov_t it;
+    bencode_iov_token_t tok;
+    struct iovec iov[2];
+
+    __set(&iov[0], "l6:abc");
+    __set(&iov[1], "defe");
+    bencode_iov_init(&it, iov, 2, NULL, 0);
+
+    CuAssertIntEquals(tc, 1, bencode_iov_next(&it, &tok));
+    CuAssertIntEquals(tc, 1, bencode_iov_next(&it, &tok));
+    CuAssertIntEquals(tc, BENCODE_IOV_STRING, tok.type);
+    CuAssertTrue(tc, !strncmp("abc", tok.str[0], tok.len[0]));
+    CuAssertTrue(tc, !strncmp("def", tok.str[1], tok.len[1]));
+    CuAssertIntEquals(tc, 1, bencode_iov_next(&it, &tok));
+    CuAssertIntEquals(tc, BENCODE_IOV_END, tok.type);
+    CuAssertIntEquals(tc, 0, bencode_iov_next(&it, &tok));
+}
+
+void TestBencodeIovStringCopiedWhenSpanningThreeSegments(
+    CuTest * tc
+)
+{
+    bencode_iov_t it;
+    bencode_iov_token_t tok;
+    struct iovec iov[4];
+    char scratch[16];
+
+    __set(&iov[0], "9:abc");
+    __set(&iov[1], "def");
+    __set(&iov[2], "");
+    __set(&iov[3], "ghi");
+    bencode_iov_init(&it, iov, 4, scratch, sizeof(scratch));
+
+    CuAssertIntEquals(tc, 1, bencode_iov_next(&it, &tok));
+    CuAssertPtrEquals(tc, scratch, (void*)tok.str[0]);
+    CuAssertIntEquals(tc, 9, tok.len[0]);
+    CuAssertIntEquals(tc, 0, tok.len[1]);
+    CuAssertTrue(tc, !strncmp("abcdefghi", tok.str[0], tok.len[0]));
+    CuAssertIntEquals(tc, 0, bencode_iov_next(&it, &tok));
+}
+
+void TestBencodeIovStringNeedsScratch(
+    CuTest * tc
+)
+{
+    bencode_iov_t it;
+    bencode_iov_token_t tok;
+    struct iovec iov[3];
+
+    __set(&iov[0], "9:abc");
+    __set(&iov[1], "def");
+    __set(&iov[2], "ghi");
+    bencode_iov_init(&it, iov, 3, NULL, 0);
+    CuAssertIntEquals(tc, -1, bencode_iov_next(&it, &tok));
+}
+
+void TestBencodeIovIntStraddlesSegments(
+    CuTest * tc
+)
+{
+    bencode_iov_t it;
+    bencode_iov_token_t tok;
+    struct iovec iov[3];
+
+    __set(&iov[0], "i-1");
+    __set(&iov[1], "23");
+    __set(&iov[2], "4e");
+    bencode_iov_init(&it, iov, 3, NULL, 0);
+    CuAssertIntEquals(tc, 1, bencode_iov_next(&it, &tok));
+    CuAssertIntEquals(tc, -1234, tok.val);
+}
+
+void TestBencodeIovIntRange(
+    CuTest * tc
+)
+{
+    bencode_iov_t it;
+    bencode_iov_token_t tok;
+    struct iovec iov[1];
+
+    __set(&iov[0], "i-9223372036854775808e");
+    bencode_iov_init(&it, iov, 1, NULL, 0);
+    CuAssertIntEquals(tc, 1, bencode_iov_next(&it, &tok));
+    CuAssertTrue(tc, LONG_MIN == tok.val);
+
+    __set(&iov[0], "i9223372036854775808e");
+    bencode_iov_init(&it, iov, 1, NULL, 0);
+    CuAssertIntEquals(tc, -1, bencode_iov_next(&it, &tok));
+
+    __set(&iov[0], "i99999999999999999999999e");
+    bencode_iov_init(&it, iov, 1, NULL, 0);
+    CuAssertIntEquals(tc, -1, bencode_iov_next(&it, &tok));
+}
+
+void TestBencodeIovTruncated(
+    CuTest * tc
+)
+{
+    bencode_iov_t it;
+    bencode_iov_token_t tok;
+    struct iovec iov[1];
+
+    __set(&iov[0], "l5:abc");
+    bencode_iov_init(&it, iov, 1, NULL, 0);
+    CuAssertIntEquals(tc, 1, bencode_iov_next(&it, &tok));
+    CuAssertIntEquals(tc, -1, bencode_iov_next(&it, &tok));
+}
+
+void TestBencodeIovDictKeyMustBeString(
+    CuTest * tc
+)
+{
+    bencode_iov_t it;
+    bencode_iov_token_t tok;
+    struct iovec iov[1];
+
+    __set(&iov[0], "di1ei2ee");
+    bencode_iov_init(&it, iov, 1, NULL, 0);
+    CuAssertIntEquals(tc, 1, bencode_iov_next(&it, &tok));
+    CuAssertIntEquals(tc, -1, bencode_iov_next(&it, &tok));
+}
+
+void TestBencodeIovHighBytes(
+    CuTest * tc
+)
+{
+    bencode_iov_t it;
+    bencode_iov_token_t tok;
+    struct iovec iov[1];
+
+    __set(&iov[0], "l\xff\xff" "e");
+    bencode_iov_init(&it, iov, 1, NULL, 0);
+    CuAssertIntEquals(tc, 1, bencode_iov_next(&it, &tok));
+    CuAssertIntEquals(tc, -1, bencode_iov_next(&it, &tok));
+
+    __set(&iov[0], "i1\xff" "e");
+    bencode_iov_init(&it, iov, 1, NULL, 0);
+    CuAssertIntEquals(tc, -1, bencode_iov_next(&it, &tok));
+
+    __set(&iov[0], "2:\xff\xff");
+    bencode_iov_init(&it, iov, 1, NULL, 0);
+    CuAssertIntEquals(tc, 1, bencode_iov_next(&it, &tok));
+    CuAssertIntEquals(tc, BENCODE_IOV_STRING, tok.type);
+}
@@ -0,0 +1,164 @@
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "CuTest.h"
+
+#include "bencode_loader.h"
+
+#define NFILES 100
+
+typedef struct
+{
+    int ok;
+    int invalid;
+    int missing;
+    int dicts;
+} counts_t;
+
+static void __count(
+    bencode_loader_file_t * f,
+    void *udata
+)
+{
+    counts_t *c = udata;
+
+    if (0 == f->err)
+    {
+        __atomic_fetch_add(&c->ok, 1, __ATOMIC_RELAXED);
+        if (bencode_is_dict(&f->be))
+            __atomic_fetch_add(&c->dicts, 1, __ATOMIC_RELAXED);
+    }
+    else if (EBADMSG == f->err)
+        __atomic_fetch_add(&c->invalid, 1, __ATOMIC_RELAXED);
+    else if (ENOENT == f->err)
+        __atomic_fetch_add(&c->missing, 1, __ATOMIC_RELAXED);
+}
+
+static void __load(
+    CuTest * tc,
+    int flags
+)
+{
+    bencode_loader_file_t files[NFILES];
+    char paths[NFILES][64];
+    char *arena = malloc(NFILES * 64);
+    counts_t c;
+    int i;
+
+    for (i = 0; i < NFILES; i++)
+    {
+        char str[64];
+        FILE *fp;
+
+        sprintf(paths[i], "/tmp/bencode_loader_%d_%d", getpid(), i);
+        files[i].path = paths[i];
+
+        /* every 10th file is missing */
+        if (0 == i % 10)
+            continue;
+
+        /* every 7th file is invalid */
+        if (0 == i % 7)
+            sprintf(str, "x%d", i);
+        else
+            sprintf(str, "d3:fooi%dee", i);
+
+        fp = fopen(paths[i], "w");
+        fputs(str, fp);
+        fclose(fp);
+    }
+
+    memset(&c, 0, sizeof(c));
+    CuAssertIntEquals(tc, 0, bencode_loader_run(files, NFILES, arena,
+                                                NFILES * 64, 4, flags,
+                                                __count, &c));
+    CuAssertIntEquals(tc, 10, c.missing);
+    CuAssertIntEquals(tc, 13, c.invalid);
+    CuAssertIntEquals(tc, 77, c.ok);
+    CuAssertIntEquals(tc, 77, c.dicts);
+
+    for (i = 0; i < NFILES; i++)
+        unlink(paths[i]);
+    free(arena);
+}
+
+void TestBencodeLoaderLoadsFiles(
+    CuTest * tc
+)
+{
+    __load(tc, 0);
+}
+
+void TestBencodeLoaderLoadsFilesWithThreads(
+    CuTest * tc
+)
+{
+    __load(tc, BENCODE_LOADER_THREADS);
+}
+
+void TestBencodeLoaderArenaTooSmall(
+    CuTest * tc
+)
+{
+    bencode_loader_file_t files[1];
+    char path[64], arena[4];
+    counts_t c;
+    FILE *fp;
+
+    sprintf(path, "/tmp/bencode_loader_%d_small", getpid());
+    fp = fopen(path, "w");
+    fputs("d3:fooi1ee", fp);
+    fclose(fp);
+
+    files[0].path = path;
+    memset(&c, 0, sizeof(c));
+    CuAssertIntEquals(tc, 0, bencode_loader_run(files, 1, arena, sizeof(arena),
+                                                1, 0, __count, &c));
+    CuAssertIntEquals(tc, ENOSPC, files[0].err);
+    unlink(path);
+}
+
+static void __load_big_then_small(
+    CuTest * tc,
+    int flags
+)
+{
+    bencode_loader_file_t files[2];
+    char paths[2][64], arena[16];
+    counts_t c;
+    FILE *fp;
+
+    sprintf(paths[0], "/tmp/bencode_loader_%d_big", getpid());
+    sprintf(paths[1], "/tmp/bencode_loader_%d_fits", getpid());
+    fp = fopen(paths[0], "w");
+    fputs("d3:fooi1e3:bar3:baze", fp);
+    fclose(fp);
+    fp = fopen(paths[1], "w");
+    fputs("d3:fooi1ee", fp);
+    fclose(fp);
+
+    files[0].path = paths[0];
+    files[1].path = paths[1];
+    memset(&c, 0, sizeof(c));
+    CuAssertIntEquals(tc, 0, bencode_loader_run(files, 2, arena, sizeof(arena),
+                                                1, flags, __count, &c));
+
+    /* the file that didn't fit doesn't use up the arena */
+    CuAssertIntEquals(tc, ENOSPC, files[0].err);
+    CuAssertIntEquals(tc, 0, files[1].err);
+    CuAssertIntEquals(tc, 1, c.dicts);
+    unlink(paths[0]);
+    unlink(paths[1]);
+}
+
+void TestBencodeLoaderArenaFullOnlyForFilesThatDontFit(
+    CuTest * tc
+)
+{
+    __load_big_then_small(tc, 0);
+    __load_big_then_small(tc, BENCODE_LOADER_THREADS);
+}
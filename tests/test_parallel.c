@@ -0,0 +1,149 @@
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "CuTest.h"
+
+#include "bencode.h"
+#include "bencode_parallel.h"
+
+/* each chunk holds ten ints, numbered from where the chunk starts */
+static void __encode_ints(
+    void *udata,
+    int chunk,
+    bencode_writer_t * w
+)
+{
+    int i;
+
+    (void)udata;
+    for (i = 0; i < 10; i++)
+        bencode_write_int(w, chunk * 10 + i);
+}
+
+static void __encode_piece(
+    void *udata,
+    int chunk,
+    bencode_writer_t * w
+)
+{
+    const char *pieces = udata;
+
+    bencode_write_raw(w, pieces + chunk * 4, 4);
+}
+
+void TestBencodeParallelEncodesList(
+    CuTest * tc
+)
+{
+    bencode_writer_t chunks[8], w;
+    char bufs[8][64], out[512];
+    bencode_t be, item;
+    long int val;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        bencode_writer_init(&chunks[i], bufs[i], sizeof(bufs[i]));
+    CuAssertIntEquals(tc, 0,
+        bencode_write_parallel(chunks, 8, 4, __encode_ints, NULL));
+
+    bencode_writer_init(&w, out, sizeof(out));
+    CuAssertIntEquals(tc, 0, bencode_write_chunks(&w, chunks, 8,
+        BENCODE_CHUNKS_LIST));
+
+    /* items come out in chunk order, whichever thread encoded them */
+    bencode_init(&be, out, w.len);
+    for (i = 0; bencode_list_has_next(&be); i++)
+    {
+        CuAssertIntEquals(tc, 1, bencode_list_get_next(&be, &item));
+        bencode_int_value(&item, &val);
+        CuAssertIntEquals(tc, i, val);
+    }
+    CuAssertIntEquals(tc, 80, i);
+}
+
+void TestBencodeParallelStringLengthFromChunks(
+    CuTest * tc
+)
+{
+    const char *pieces = "aaaabbbbccccdddd";
+    bencode_writer_t chunks[4];
+    char bufs[4][8], hdr[BENCODE_CHUNKS_HDR_LEN];
+    struct iovec iov[6];
+    int i, n;
+
+    for (i = 0; i < 4; i++)
+        bencode_writer_init(&chunks[i], bufs[i], sizeof(bufs[i]));
+    CuAssertIntEquals(tc, 0, bencode_write_parallel(chunks, 4, 2,
+        __encode_piece, (void*)pieces));
+
+    n = bencode_chunks_iovec(chunks, 4, BENCODE_CHUNKS_STRING, hdr, iov);
+    CuAssertIntEquals(tc, 5, n);
+    CuAssertIntEquals(tc, 3, iov[0].iov_len);
+    CuAssertTrue(tc, !strncmp("16:", iov[0].iov_base, 3));
+
+    /* the iovecs point straight at the chunk buffers */
+    for (i = 0; i < 4; i++)
+    {
+        CuAssertPtrEquals(tc, bufs[i], iov[i + 1].iov_base);
+        CuAssertIntEquals(tc, 4, iov[i + 1].iov_len);
+    }
+}
+
+void TestBencodeParallelIovecWritesDocument(
+    CuTest * tc
+)
+{
+    bencode_writer_t chunks[3];
+    char bufs[3][64], hdr[BENCODE_CHUNKS_HDR_LEN], out[256];
+    struct iovec iov[5];
+    int i, n, fds[2];
+    ssize_t got;
+
+    for (i = 0; i < 3; i++)
+        bencode_writer_init(&chunks[i], bufs[i], sizeof(bufs[i]));
+    bencode_write_parallel(chunks, 3, 3, __encode_ints, NULL);
+    /* an empty chunk gets no iovec */
+    chunks[1].len = 0;
+
+    n = bencode_chunks_iovec(chunks, 3, BENCODE_CHUNKS_LIST, hdr, iov);
+    CuAssertIntEquals(tc, 4, n);
+
+    CuAssertIntEquals(tc, 0, pipe(fds));
+    CuAssertTrue(tc, 0 < writev(fds[1], iov, n));
+    close(fds[1]);
+    got = read(fds[0], out, sizeof(out));
+    close(fds[0]);
+
+    CuAssertTrue(tc, 0 < got);
+    CuAssertIntEquals(tc, 'l', out[0]);
+    CuAssertIntEquals(tc, 'e', out[got - 1]);
+    CuAssertIntEquals(tc, 0, bencode_validate(out, got));
+}
+
+void TestBencodeParallelReportsOverflow(
+    CuTest * tc
+)
+{
+    bencode_writer_t chunks[4], w;
+    char bufs[4][64], small[8], out[64];
+    struct iovec iov[6];
+    char hdr[BENCODE_CHUNKS_HDR_LEN];
+    int i;
+
+    for (i = 0; i < 4; i++)
+        bencode_writer_init(&chunks[i], bufs[i], sizeof(bufs[i]));
+    bencode_writer_init(&chunks[2], small, sizeof(small));
+    CuAssertIntEquals(tc, -1,
+        bencode_write_parallel(chunks, 4, 2, __encode_ints, NULL));
+
+    /* len says how big the buffer needs to be */
+    CuAssertIntEquals(tc, 40, chunks[2].len);
+    CuAssertIntEquals(tc, -1, bencode_chunks_iovec(chunks, 4,
+        BENCODE_CHUNKS_LIST, hdr, iov));
+    bencode_writer_init(&w, out, sizeof(out));
+    CuAssertIntEquals(tc, -1, bencode_write_chunks(&w, chunks, 4,
+        BENCODE_CHUNKS_LIST));
+}
@@ -0,0 +1,136 @@
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "CuTest.h"
+
+#include "bencode_sidecar.h"
+
+static int __write_source(
+    char *path,
+    const char *str
+)
+{
+    int fd;
+
+    strcpy(path, "/tmp/bencode_sidecar_XXXXXX");
+    fd = mkstemp(path);
+    if (-1 == fd)
+        return -1;
+    if ((ssize_t)strlen(str) != write(fd, str, strlen(str)))
+        return -1;
+    return fd;
+}
+
+void TestBencodeSidecarRoundTrip(
+    CuTest * tc
+)
+{
+    bencode_sindex_t idx, idx2;
+    const char *str = "d3:keyl4:test3:fooe3:food1:ai1eee";
+    char src[64], side[80];
+    size_t size = bencode_sindex_size(str, strlen(str));
+    void *mem = malloc(size);
+    int fd = __write_source(src, str);
+
+    CuAssertTrue(tc, -1 != fd);
+    sprintf(side, "%s.idx", src);
+    CuAssertIntEquals(tc, 0, bencode_sindex_build(&idx, mem, size, str, strlen(str)));
+    CuAssertIntEquals(tc, 0, bencode_sidecar_save(&idx, side, fd));
+    CuAssertIntEquals(tc, 0, bencode_sidecar_load(&idx2, side, fd, str, strlen(str)));
+    CuAssertIntEquals(tc, idx.nvalues, idx2.nvalues);
+    CuAssertPtrEquals(tc, (void*)(str + 19),
+                      (void*)bencode_sindex_value_end(&idx2, str + 6));
+    CuAssertPtrEquals(tc, (void*)(str + 24),
+                      (void*)bencode_sindex_child(&idx2, str, 3));
+    bencode_sidecar_unload(&idx2);
+
+    close(fd);
+    unlink(src);
+    unlink(side);
+    free(mem);
+}
+
+void TestBencodeSidecarRejectsChangedSource(
+    CuTest * tc
+)
+{
+    bencode_sindex_t idx, idx2;
+    const char *str = "l4:test3:fooe";
+    const char *str2 = "l4:tesx3:fooe";
+    char src[64], side[80];
+    size_t size = bencode_sindex_size(str, strlen(str));
+    void *mem = malloc(size);
+    int fd = __write_source(src, str);
+
+    sprintf(side, "%s.idx", src);
+    bencode_sindex_build(&idx, mem, size, str, strlen(str));
+    CuAssertIntEquals(tc, 0, bencode_sidecar_save(&idx, side, fd));
+
+    /* same size, and most likely the same mtime */
+    CuAssertTrue(tc, (ssize_t)strlen(str2) == pwrite(fd, str2, strlen(str2), 0));
+    CuAssertIntEquals(tc, -1, bencode_sidecar_load(&idx2, side, fd, str2, strlen(str2)));
+
+    close(fd);
+    unlink(src);
+    unlink(side);
+    free(mem);
+}
+
+void TestBencodeSidecarRejectsCorruptIndex(
+    CuTest * tc
+)
+{
+    bencode_sindex_t idx, idx2;
+    const char *str = "d3:keyl4:test3:fooe3:food1:ai1eee";
+    char src[64], side[80], c;
+    int64_t nvalues = 1L << 40;
+    size_t size = bencode_sindex_size(str, strlen(str));
+    void *mem = malloc(size);
+    int fd = __write_source(src, str), sfd;
+    off_t end;
+
+    sprintf(side, "%s.idx", src);
+    bencode_sindex_build(&idx, mem, size, str, strlen(str));
+    CuAssertIntEquals(tc, 0, bencode_sidecar_save(&idx, side, fd));
+
+    /* flip a bit in the index itself */
+    sfd = open(side, O_RDWR);
+    end = lseek(sfd, 0, SEEK_END);
+    CuAssertIntEquals(tc, 1, pread(sfd, &c, 1, end - 1));
+    c ^= 1;
+    CuAssertIntEquals(tc, 1, pwrite(sfd, &c, 1, end - 1));
+    CuAssertIntEquals(tc, -1, bencode_sidecar_load(&idx2, side, fd, str, strlen(str)));
+
+    /* an impossible value count in the header; it follows the magic,
+     * version, sample, size, mtime, mtime_nsec, hash and len fields */
+    c ^= 1;
+    CuAssertIntEquals(tc, 1, pwrite(sfd, &c, 1, end - 1));
+    CuAssertIntEquals(tc, 0, bencode_sidecar_load(&idx2, side, fd, str, strlen(str)));
+    bencode_sidecar_unload(&idx2);
+    CuAssertIntEquals(tc, 8, pwrite(sfd, &nvalues, 8, 56));
+    CuAssertIntEquals(tc, -1, bencode_sidecar_load(&idx2, side, fd, str, strlen(str)));
+
+    close(sfd);
+    close(fd);
+    unlink(src);
+    unlink(side);
+    free(mem);
+}
+
+void TestBencodeSidecarMissing(
+    CuTest * tc
+)
+{
+    bencode_sindex_t idx;
+    const char *str = "le";
+    char src[64];
+    int fd = __write_source(src, str);
+
+    CuAssertIntEquals(tc, -1, bencode_sidecar_load(&idx, "/nonexistent/x.idx", fd, str, 2));
+    close(fd);
+    unlink(src);
+}
@@ -0,0 +1,217 @@
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "CuTest.h"
+
+#include "bencode.h"
+#include "bencode_sindex.h"
+
+static void *__build(
+    bencode_sindex_t * idx,
+    const char *str,
+    long int len
+)
+{
+    size_t size = bencode_sindex_size(str, len);
+    void *mem = malloc(size);
+
+    if (0 != bencode_sindex_build(idx, mem, size, str, len))
+    {
+        free(mem);
+        return NULL;
+    }
+    return mem;
+}
+
+void TestBencodeSindexValueEnd(
+    CuTest * tc
+)
+{
+    bencode_sindex_t idx;
+    const char *str = "d3:keyl4:test3:fooe3:food1:ai1eee";
+    void *mem = __build(&idx, str, strlen(str));
+
+    CuAssertPtrNotNull(tc, mem);
+    CuAssertIntEquals(tc, 9, idx.nvalues);
+    CuAssertPtrEquals(tc, (void*)(str + strlen(str)),
+                      (void*)bencode_sindex_value_end(&idx, str));
+    /* the list */
+    CuAssertPtrEquals(tc, (void*)(str + 19),
+                      (void*)bencode_sindex_value_end(&idx, str + 6));
+    /* the inner dict */
+    CuAssertPtrEquals(tc, (void*)(str + 32),
+                      (void*)bencode_sindex_value_end(&idx, str + 24));
+    /* a string */
+    CuAssertPtrEquals(tc, (void*)(str + 13),
+                      (void*)bencode_sindex_value_end(&idx, str + 7));
+    free(mem);
+}
+
+void TestBencodeSindexValueEndRejectsNonValue(
+    CuTest * tc
+)
+{
+    bencode_sindex_t idx;
+    const char *str = "l4:test3:fooe";
+    void *mem = __build(&idx, str, strlen(str));
+
+    CuAssertPtrEquals(tc, NULL, (void*)bencode_sindex_value_end(&idx, str + 3));
+    free(mem);
+}
+
+void TestBencodeSindexEmptyContainers(
+    CuTest * tc
+)
+{
+    bencode_sindex_t idx;
+    const char *str = "lldeleei1ee";
+    void *mem = __build(&idx, str, strlen(str));
+
+    CuAssertPtrEquals(tc, (void*)(str + 7),
+                      (void*)bencode_sindex_value_end(&idx, str + 1));
+    CuAssertPtrEquals(tc, (void*)(str + 4),
+                      (void*)bencode_sindex_value_end(&idx, str + 2));
+    CuAssertPtrEquals(tc, NULL, (void*)bencode_sindex_child(&idx, str + 2, 0));
+    CuAssertPtrEquals(tc, (void*)(str + 7),
+                      (void*)bencode_sindex_child(&idx, str, 1));
+    free(mem);
+}
+
+void TestBencodeSindexChild(
+    CuTest * tc
+)
+{
+    bencode_sindex_t idx;
+    const char *str = "d3:keyl4:test3:fooe3:food1:ai1eee";
+    void *mem = __build(&idx, str, strlen(str));
+
+    CuAssertPtrEquals(tc, (void*)(str + 1),
+                      (void*)bencode_sindex_child(&idx, str, 0));
+    CuAssertPtrEquals(tc, (void*)(str + 19),
+                      (void*)bencode_sindex_child(&idx, str, 2));
+    CuAssertPtrEquals(tc, (void*)(str + 24),
+                      (void*)bencode_sindex_child(&idx, str, 3));
+    CuAssertPtrEquals(tc, NULL, (void*)bencode_sindex_child(&idx, str, 4));
+    CuAssertPtrEquals(tc, (void*)(str + 13),
+                      (void*)bencode_sindex_child(&idx, str + 6, 1));
+    free(mem);
+}
+
+void TestBencodeSindexInvalid(
+    CuTest * tc
+)
+{
+    CuAssertTrue(tc, 0 == bencode_sindex_size("l5:teste", 8));
+    CuAssertTrue(tc, 0 == bencode_sindex_size("li1e", 4));
+    CuAssertTrue(tc, 0 == bencode_sindex_size("i1x", 3));
+}
+
+void TestBencodeSindexMatchesIteratorOnLargeList(
+    CuTest * tc
+)
+{
+    bencode_sindex_t idx;
+    bencode_t ben, item;
+    char *str = malloc(200000);
+    const char *prev = NULL;
+    int i, len = 0;
+    void *mem;
+
+    len += sprintf(str, "l");
+    for (i = 0; i < 3000; i++)
+        len += sprintf(str + len, "d1:ai%de1:blli%deee1:c0:e", i, i);
+    len += sprintf(str + len, "e");
+
+    mem = __build(&idx, str, len);
+    CuAssertPtrNotNull(tc, mem);
+
+    bencode_init(&ben, str, len);
+    while (bencode_list_has_next(&ben))
+    {
+        CuAssertIntEquals(tc, 1, bencode_list_get_next(&ben, &item));
+        if (prev)
+            CuAssertPtrEquals(tc, (void*)item.str,
+                              (void*)bencode_sindex_value_end(&idx, prev));
+        prev = item.str;
+    }
+
+    CuAssertPtrEquals(tc, (void*)(str + len - 1),
+                      (void*)bencode_sindex_value_end(&idx, prev));
+    CuAssertPtrEquals(tc, (void*)prev,
+                      (void*)bencode_sindex_child(&idx, str, 2999));
+    free(mem);
+    free(str);
+}
+
+/**
+ * Write a random value, recording where each container starts
+ * @return length written */
+static int __random_value(
+    char *str,
+    int depth,
+    const char **starts,
+    int *nstarts
+)
+{
+    int len = 0, n, i;
+
+    if (depth < 40 && rand() % 2)
+    {
+        starts[(*nstarts)++] = str;
+        str[len++] = rand() % 2 ? 'l' : 'd';
+        for (n = rand() % 4, i = 0; i < n; i++)
+        {
+            if ('d' == *str)
+                len += sprintf(str + len, "1:%c", 'a' + i);
+            len += __random_value(str + len, depth + 1, starts, nstarts);
+        }
+        str[len++] = 'e';
+    }
+    else
+        len += sprintf(str + len, "i%de", rand() % 1000);
+
+    return len;
+}
+
+void TestBencodeSindexValueEndAcrossSuperblocks(
+    CuTest * tc
+)
+{
+    bencode_sindex_t idx;
+    bencode_t ben;
+    char *str = malloc(8 << 20);
+    const char **starts = malloc(sizeof(char *) * (1 << 20));
+    int i, len = 0, nstarts = 0;
+    void *mem;
+
+    /* nest everything deeply, so that some closes are far away */
+    srand(1);
+    for (i = 0; i < 1000; i++)
+    {
+        starts[nstarts++] = str + len;
+        len += sprintf(str + len, "li%de", i);
+    }
+    for (i = 0; i < 20000; i++)
+        len += __random_value(str + len, 0, starts, &nstarts);
+    for (i = 0; i < 1000; i++)
+        len += sprintf(str + len, "e");
+
+    mem = __build(&idx, str, len);
+    CuAssertPtrNotNull(tc, mem);
+    CuAssertTrue(tc, 64 < idx.tsize);
+
+    for (i = 0; i < nstarts; i++)
+    {
+        bencode_init(&ben, starts[i], str + len - starts[i]);
+        CuAssertPtrEquals(tc, (void*)bencode_value_end(&ben),
+                          (void*)bencode_sindex_value_end(&idx, starts[i]));
+    }
+
+    CuAssertPtrEquals(tc, (void*)(str + len),
+                      (void*)bencode_sindex_value_end(&idx, str));
+    free(mem);
+    free(starts);
+    free(str);
+}
@@ -0,0 +1,205 @@
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "CuTest.h"
+
+#include "bencode.h"
+#include "bencode_stream.h"
+
+void TestBencodeStreamWholeValue(
+    CuTest * tc
+)
+{
+    bencode_stream_t s;
+    const char *str = "d3:foo3:bar3:keyli1ei-20eee";
+    int used;
+
+    bencode_stream_init(&s);
+    CuAssertIntEquals(tc, BENCODE_STREAM_DONE,
+                      bencode_stream_feed(&s, str, strlen(str), &used));
+    CuAssertIntEquals(tc, (int)strlen(str), used);
+}
+
+void TestBencodeStreamByteAtATime(
+    CuTest * tc
+)
+{
+    bencode_stream_t s;
+    const char *str = "d3:foo3:bar3:keyli1ei-20eee";
+    int i, used, len = strlen(str);
+
+    bencode_stream_init(&s);
+    for (i = 0; i < len - 1; i++)
+        CuAssertIntEquals(tc, BENCODE_STREAM_NEED_MORE,
+                          bencode_stream_feed(&s, str + i, 1, &used));
+    CuAssertIntEquals(tc, BENCODE_STREAM_DONE,
+                      bencode_stream_feed(&s, str + i, 1, &used));
+    CuAssertIntEquals(tc, len, s.consumed);
+}
+
+void TestBencodeStreamStringSplitAcrossFeeds(
+    CuTest * tc
+)
+{
+    bencode_stream_t s;
+    int used;
+
+    bencode_stream_init(&s);
+    CuAssertIntEquals(tc, BENCODE_STREAM_NEED_MORE,
+                      bencode_stream_feed(&s, "l10:abc", 7, &used));
+    CuAssertIntEquals(tc, BENCODE_STREAM_NEED_MORE,
+                      bencode_stream_feed(&s, "defghij", 7, &used));
+    CuAssertIntEquals(tc, BENCODE_STREAM_DONE,
+                      bencode_stream_feed(&s, "e", 1, &used));
+}
+
+void TestBencodeStreamStopsAtEndOfValue(
+    CuTest * tc
+)
+{
+    bencode_stream_t s;
+    int used;
+
+    bencode_stream_init(&s);
+    CuAssertIntEquals(tc, BENCODE_STREAM_DONE,
+                      bencode_stream_feed(&s, "i42ei43e", 8, &used));
+    CuAssertIntEquals(tc, 4, used);
+}
+
+void TestBencodeStreamDictKeyMustBeString(
+    CuTest * tc
+)
+{
+    bencode_stream_t s;
+    int used;
+
+    bencode_stream_init(&s);
+    CuAssertIntEquals(tc, BENCODE_STREAM_ERROR,
+                      bencode_stream_feed(&s, "di1e3:fooe", 10, &used));
+    CuAssertIntEquals(tc, 1, used);
+}
+
+void TestBencodeStreamDictKeyMissingValue(
+    CuTest * tc
+)
+{
+    bencode_stream_t s;
+    int used;
+
+    bencode_stream_init(&s);
+    CuAssertIntEquals(tc, BENCODE_STREAM_ERROR,
+                      bencode_stream_feed(&s, "d3:fooe", 7, &used));
+}
+
+void TestBencodeStreamDepthLimit(
+    CuTest * tc
+)
+{
+    bencode_stream_t s;
+    char str[BENCODE_STREAM_MAX_DEPTH + 1];
+    int used;
+
+    memset(str, 'l', sizeof(str));
+    bencode_stream_init(&s);
+    CuAssertIntEquals(tc, BENCODE_STREAM_ERROR,
+                      bencode_stream_feed(&s, str, sizeof(str), &used));
+}
+
+void TestBencodeStreamIntRange(
+    CuTest * tc
+)
+{
+    const char *ok[] = { "i9223372036854775807e", "i-9223372036854775808e" };
+    const char *bad[] = { "i9223372036854775808e", "i-9223372036854775809e",
+        "i99999999999999999999999e" };
+    bencode_stream_t s;
+    int i, used;
+
+    for (i = 0; i < 2; i++)
+    {
+        bencode_stream_init(&s);
+        CuAssertIntEquals(tc, BENCODE_STREAM_DONE,
+            bencode_stream_feed(&s, ok[i], strlen(ok[i]), &used));
+    }
+
+    /* the same ints bencode_validate rejects */
+    for (i = 0; i < 3; i++)
+    {
+        bencode_stream_init(&s);
+        CuAssertIntEquals(tc, BENCODE_STREAM_ERROR,
+            bencode_stream_feed(&s, bad[i], strlen(bad[i]), &used));
+        CuAssertIntEquals(tc, -1, bencode_validate((char*)bad[i], strlen(bad[i])));
+    }
+
+    /* the value carries over between feeds */
+    bencode_stream_init(&s);
+    CuAssertIntEquals(tc, BENCODE_STREAM_NEED_MORE,
+        bencode_stream_feed(&s, "i92233720368", 12, &used));
+    CuAssertIntEquals(tc, BENCODE_STREAM_ERROR,
+        bencode_stream_feed(&s, "54775808e", 9, &used));
+}
+
+void TestBencodeStreamValidateBatch(
+    CuTest * tc
+)
+{
+    char big[300];
+    const char *bufs[12];
+    int lens[12], results[12], i;
+
+    /* a long string spans several cache lines */
+    strcpy(big, "l250:");
+    memset(big + 5, 'x', 250);
+    strcpy(big + 255, "i7ee");
+
+    for (i = 0; i < 12; i++)
+    {
+        switch (i % 4)
+        {
+        case 0: bufs[i] = "d3:foo3:bar3:keyli1ei-20eee"; break;
+        case 1: bufs[i] = big; break;
+        case 2: bufs[i] = "d3:foo3:bar"; break;
+        case 3: bufs[i] = "i1ei2e"; break;
+        }
+        lens[i] = strlen(bufs[i]);
+    }
+
+    CuAssertIntEquals(tc, 6, bencode_stream_validate_batch(bufs, lens, 12, results));
+    for (i = 0; i < 12; i++)
+        CuAssertIntEquals(tc, i % 4 < 2 ? 0 : -1, results[i]);
+}
+
+void TestBencodeStreamValidateBatchEmpty(
+    CuTest * tc
+)
+{
+    const char *bufs[] = { "" };
+    int lens[] = { 0 }, results[1];
+
+    CuAssertIntEquals(tc, 0, bencode_stream_validate_batch(bufs, lens, 0, results));
+    CuAssertIntEquals(tc, 0, bencode_stream_validate_batch(bufs, lens, 1, results));
+    CuAssertIntEquals(tc, -1, results[0]);
+}
+
+void TestBencodeStreamValidateBatchIsStricterThanValidate(
+    CuTest * tc
+)
+{
+    const char *bufs[] = { "i1ei2e", "d1:ai1eed1:d0:e",
+        "d3:url4:infod1:ai1eee", "i-09223372036854775808e" };
+    int lens[4], results[4], i;
+
+    for (i = 0; i < 4; i++)
+    {
+        lens[i] = strlen(bufs[i]);
+        CuAssertIntEquals(tc, 0, bencode_validate((char *)bufs[i], lens[i]));
+    }
+
+    CuAssertIntEquals(tc, 1, bencode_stream_validate_batch(bufs, lens, 4, results));
+    CuAssertIntEquals(tc, -1, results[0]);
+    CuAssertIntEquals(tc, -1, results[1]);
+    CuAssertIntEquals(tc, -1, results[2]);
+    CuAssertIntEquals(tc, 0, results[3]);
+}
@@ -0,0 +1,180 @@
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "CuTest.h"
+
+#include "bencode_writer.h"
+
+void TestBencodeWriterWritesValues(
+    CuTest * tc
+)
+{
+    bencode_writer_t w;
+    char buf[64];
+
+    bencode_writer_init(&w, buf, sizeof(buf));
+    bencode_write_dict_start(&w);
+    bencode_write_string(&w, "foo", 3);
+    bencode_write_list_start(&w);
+    bencode_write_int(&w, -42);
+    bencode_write_string(&w, "", 0);
+    bencode_write_end(&w);
+    CuAssertIntEquals(tc, 0, bencode_write_end(&w));
+    CuAssertIntEquals(tc, 16, w.len);
+    CuAssertTrue(tc, !strncmp("d3:fooli-42e0:ee", buf, w.len));
+}
+
+void TestBencodeWriterCountsWhenFull(
+    CuTest * tc
+)
+{
+    bencode_writer_t w;
+    char buf[4];
+
+    bencode_writer_init(&w, buf, sizeof(buf));
+    CuAssertIntEquals(tc, -1, bencode_write_string(&w, "hello", 5));
+    CuAssertIntEquals(tc, 7, w.len);
+}
+
+static int __merge(
+    const char *a,
+    const char *b,
+    int policy,
+    char *out,
+    int cap
+)
+{
+    bencode_t ba, bb;
+    bencode_writer_t w;
+    int ret;
+
+    bencode_init(&ba, a, strlen(a));
+    bencode_init(&bb, b, strlen(b));
+    bencode_writer_init(&w, out, cap);
+    ret = bencode_merge(&ba, &bb, &w, policy);
+    if (0 == ret && w.len < cap)
+        out[w.len] = '\0';
+    return ret;
+}
+
+void TestBencodeMergeInterleavesKeys(
+    CuTest * tc
+)
+{
+    char out[128];
+
+    CuAssertIntEquals(tc, 0, __merge("d1:ai1e1:cli1eee", "d1:bi2e1:d3:fooe",
+                                     BENCODE_MERGE_PREFER_B, out, sizeof(out)));
+    CuAssertStrEquals(tc, "d1:ai1e1:bi2e1:cli1ee1:d3:fooe", out);
+}
+
+void TestBencodeMergeConflictPolicy(
+    CuTest * tc
+)
+{
+    char out[128];
+
+    CuAssertIntEquals(tc, 0, __merge("d1:ai1e1:bi2ee", "d1:bi3ee",
+                                     BENCODE_MERGE_PREFER_B, out, sizeof(out)));
+    CuAssertStrEquals(tc, "d1:ai1e1:bi3ee", out);
+    CuAssertIntEquals(tc, 0, __merge("d1:ai1e1:bi2ee", "d1:bi3ee",
+                                     BENCODE_MERGE_PREFER_A, out, sizeof(out)));
+    CuAssertStrEquals(tc, "d1:ai1e1:bi2ee", out);
+    CuAssertIntEquals(tc, -1, __merge("d1:ai1e1:bi2ee", "d1:bi3ee",
+                                      BENCODE_MERGE_FAIL, out, sizeof(out)));
+}
+
+void TestBencodeMergeRecursesIntoDicts(
+    CuTest * tc
+)
+{
+    char out[128];
+
+    CuAssertIntEquals(tc, 0, __merge("d4:infod1:xi1e1:zi3ee1:ylee", "d4:infod1:yi2eee",
+                                     BENCODE_MERGE_PREFER_B, out, sizeof(out)));
+    CuAssertStrEquals(tc, "d4:infod1:xi1e1:yi2e1:zi3ee1:ylee", out);
+}
+
+void TestBencodeMergeTopLevelConflict(
+    CuTest * tc
+)
+{
+    char out[128];
+
+    CuAssertIntEquals(tc, 0, __merge("d1:ai1ee", "li1ei2ee",
+                                     BENCODE_MERGE_PREFER_B, out, sizeof(out)));
+    CuAssertStrEquals(tc, "li1ei2ee", out);
+    CuAssertIntEquals(tc, 0, __merge("d1:ai1ee", "li1ei2ee",
+                                     BENCODE_MERGE_PREFER_A, out, sizeof(out)));
+    CuAssertStrEquals(tc, "d1:ai1ee", out);
+}
+
+void TestBencodeMergeEmptyDict(
+    CuTest * tc
+)
+{
+    char out[128];
+
+    CuAssertIntEquals(tc, 0, __merge("de", "i1e",
+                                     BENCODE_MERGE_PREFER_A, out, sizeof(out)));
+    CuAssertStrEquals(tc, "de", out);
+    CuAssertIntEquals(tc, 0, __merge("d1:ade1:bi1ee", "d1:bi2ee",
+                                     BENCODE_MERGE_PREFER_B, out, sizeof(out)));
+    CuAssertStrEquals(tc, "d1:ade1:bi2ee", out);
+}
+
+void TestBencodeMergeEqualValuesDontConflict(
+    CuTest * tc
+)
+{
+    char out[128];
+
+    CuAssertIntEquals(tc, 0, __merge("d1:ai1e1:bli2eee", "d1:ai1e1:bli2ee1:c0:e",
+                                     BENCODE_MERGE_FAIL, out, sizeof(out)));
+    CuAssertStrEquals(tc, "d1:ai1e1:bli2ee1:c0:e", out);
+    CuAssertIntEquals(tc, -1, __merge("d1:ai1ee", "d1:ai2ee",
+                                      BENCODE_MERGE_FAIL, out, sizeof(out)));
+}
+
+void TestBencodeMergeBufferTooSmall(
+    CuTest * tc
+)
+{
+    bencode_t ba, bb;
+    bencode_writer_t w;
+    char out[8];
+
+    bencode_init(&ba, "d1:ai1ee", 8);
+    bencode_init(&bb, "d1:bi2ee", 8);
+    bencode_writer_init(&w, out, sizeof(out));
+    CuAssertIntEquals(tc, -1, bencode_merge(&ba, &bb, &w, BENCODE_MERGE_PREFER_B));
+    CuAssertIntEquals(tc, 14, w.len);
+}
+
+void TestBencodeMergeFailsOnTruncatedDict(
+    CuTest * tc
+)
+{
+    char out[128];
+
+    CuAssertIntEquals(tc, -1, __merge("d1:ai1e", "de",
+                                      BENCODE_MERGE_PREFER_B, out, sizeof(out)));
+    CuAssertIntEquals(tc, -1, __merge("de", "d1:ai1e",
+                                      BENCODE_MERGE_PREFER_B, out, sizeof(out)));
+    CuAssertIntEquals(tc, -1, __merge("d4:infod1:ai1ee", "d4:infod1:bi2e",
+                                      BENCODE_MERGE_PREFER_B, out, sizeof(out)));
+}
+
+void TestBencodeMergeFailsOnUnsortedKeys(
+    CuTest * tc
+)
+{
+    char out[128];
+
+    CuAssertIntEquals(tc, -1, __merge("d1:bi1e1:ai2ee", "d1:ai3ee",
+                                      BENCODE_MERGE_PREFER_B, out, sizeof(out)));
+    CuAssertIntEquals(tc, -1, __merge("d1:ai3ee", "d1:ai1e1:ai2ee",
+                                      BENCODE_MERGE_PREFER_B, out, sizeof(out)));
+}